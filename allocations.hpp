@@ -0,0 +1,133 @@
+// counts every allocation made through operator new, for the tests and the
+// benchmark. it replaces every global operator new and delete, plain,
+// nothrow and aligned, so include it from exactly one translation unit of a
+// program.
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static size_t allocations = 0;
+
+static void *allocate(size_t size, size_t align) {
+    allocations++;
+    size = size ? size : 1;
+    if (align <= alignof(std::max_align_t)) {
+        return malloc(size);
+    }
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+// operator new is replaced with malloc below, which gcc cannot see
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+    if (void *p = allocate(size, 0)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    if (void *p = allocate(size, (size_t)align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size, 0);
+}
+
+void *operator new(
+    size_t size, std::align_val_t align, const std::nothrow_t &
+) noexcept {
+    return allocate(size, (size_t)align);
+}
+
+void *operator new[](
+    size_t size, std::align_val_t align, const std::nothrow_t &
+) noexcept {
+    return allocate(size, (size_t)align);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(
+    void *p, std::align_val_t, const std::nothrow_t &
+) noexcept {
+    free(p);
+}
+
+void operator delete[](
+    void *p, std::align_val_t, const std::nothrow_t &
+) noexcept {
+    free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// the allocations made while running `f`
+template <typename F>
+size_t countAllocations(F &&f) {
+    size_t before = allocations;
+    f();
+    return allocations - before;
+}
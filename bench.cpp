@@ -0,0 +1,424 @@
+//
+// compile me with `g++ -std=c++20 -O2 bench.cpp -I . -o bench`
+//
+// runs serialize, deserialize and prettify over deterministic synthetic
+// corpora and prints the results as json. pass `--perf` to also count
+// cycles and instructions with perf_event_open, and `--rounds N` to change
+// how many times each corpus is processed.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "json.hpp"
+#include "allocations.hpp"
+
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define BENCH_PERF 1
+#else
+#define BENCH_PERF 0
+#endif
+
+// PERF COUNTERS {{{
+class PerfCounter
+{
+    int m_fd = -1;
+
+public:
+    PerfCounter(uint64_t config) {
+#if BENCH_PERF
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    PerfCounter(const PerfCounter &) = delete;
+    PerfCounter &operator=(const PerfCounter &) = delete;
+
+    ~PerfCounter() {
+#if BENCH_PERF
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+#endif
+    }
+
+    bool available() const {
+        return m_fd >= 0;
+    }
+
+    void start() {
+#if BENCH_PERF
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#if BENCH_PERF
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+};
+// }}}
+// CORPORA {{{
+// a tiny xorshift generator, so the corpora are identical on every platform
+class Random
+{
+    uint64_t m_state;
+
+public:
+    Random(uint64_t seed) : m_state(seed) {}
+
+    uint64_t next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return m_state;
+    }
+
+    int range(int lo, int hi) {
+        return lo + (int)(next() % (uint64_t)(hi - lo + 1));
+    }
+
+    double real(double lo, double hi) {
+        return lo + (hi - lo) * (double)(next() >> 11) / (double)(1ull << 53);
+    }
+
+    std::string word(int minLength, int maxLength) {
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+        std::string word(range(minLength, maxLength), ' ');
+        for (char &c : word) {
+            c = letters[next() % 26];
+        }
+        return word;
+    }
+
+    std::string sentence(int words) {
+        std::string sentence;
+        for (int i = 0; i < words; i++) {
+            if (i) {
+                sentence += ' ';
+            }
+            sentence += word(2, 10);
+        }
+        return sentence;
+    }
+};
+
+struct LogEntry {
+    std::string timestamp;
+    std::string level;
+    std::string service;
+    std::string message;
+    std::map<std::string, std::string> tags;
+};
+REFLECT(LogEntry, timestamp, level, service, message, tags);
+
+struct Sample {
+    int64_t time;
+    double value;
+    double min;
+    double max;
+    int count;
+};
+REFLECT(Sample, time, value, min, max, count);
+
+struct TimeSeries {
+    std::string metric;
+    std::vector<Sample> samples;
+    std::vector<double> values;
+};
+REFLECT(TimeSeries, metric, samples, values);
+
+struct Tree {
+    std::string name;
+    int value;
+    std::vector<Tree> children;
+};
+REFLECT(Tree, name, value, children);
+
+struct Wide {
+    int i0, i1, i2, i3, i4, i5, i6, i7;
+    double d0, d1, d2, d3, d4, d5, d6, d7;
+    std::string s0, s1, s2, s3, s4, s5, s6, s7;
+    bool b0, b1, b2, b3, b4, b5, b6, b7;
+};
+REFLECT(
+    Wide, i0, i1, i2, i3, i4, i5, i6, i7, d0, d1, d2, d3, d4, d5, d6, d7,
+    s0, s1, s2, s3, s4, s5, s6, s7, b0, b1, b2, b3, b4, b5, b6, b7
+);
+
+using LargeMap = std::map<std::string, double>;
+
+std::vector<std::vector<LogEntry>> logs(Random &random, int documents) {
+    static const char *levels[] = {"debug", "info", "warning", "error"};
+    std::vector<std::vector<LogEntry>> corpus(documents);
+    for (auto &document : corpus) {
+        for (int i = 0; i < 100; i++) {
+            LogEntry entry;
+            entry.timestamp = "2024-01-01T00:00:00." + std::to_string(i);
+            entry.level = levels[random.next() % 4];
+            entry.service = random.word(4, 12);
+            entry.message = random.sentence(random.range(5, 30));
+            for (int j = random.range(0, 4); j > 0; j--) {
+                entry.tags[random.word(3, 8)] = random.word(3, 16);
+            }
+            document.push_back(entry);
+        }
+    }
+    return corpus;
+}
+
+std::vector<TimeSeries> timeSeries(Random &random, int documents) {
+    std::vector<TimeSeries> corpus(documents);
+    for (auto &document : corpus) {
+        document.metric = random.word(8, 20);
+        int64_t time = 1700000000000;
+        for (int i = 0; i < 500; i++) {
+            double value = random.real(-1000, 1000);
+            time += random.range(900, 1100);
+            document.samples.push_back({
+                time, value, value - random.real(0, 10),
+                value + random.real(0, 10), random.range(1, 1000)
+            });
+            document.values.push_back(random.real(0, 1));
+        }
+    }
+    return corpus;
+}
+
+Tree tree(Random &random, int depth) {
+    Tree node {random.word(3, 10), random.range(0, 1000000), {}};
+    if (depth > 0) {
+        for (int i = random.range(1, 4); i > 0; i--) {
+            node.children.push_back(tree(random, depth - 1));
+        }
+    }
+    return node;
+}
+
+std::vector<Tree> trees(Random &random, int documents) {
+    std::vector<Tree> corpus;
+    for (int i = 0; i < documents; i++) {
+        corpus.push_back(tree(random, 6));
+    }
+    return corpus;
+}
+
+std::vector<std::vector<Wide>> wides(Random &random, int documents) {
+    std::vector<std::vector<Wide>> corpus(documents);
+    for (auto &document : corpus) {
+        for (int i = 0; i < 50; i++) {
+            Wide wide;
+            for (int *p : {&wide.i0, &wide.i1, &wide.i2, &wide.i3,
+                    &wide.i4, &wide.i5, &wide.i6, &wide.i7}) {
+                *p = random.range(-100000, 100000);
+            }
+            for (double *p : {&wide.d0, &wide.d1, &wide.d2, &wide.d3,
+                    &wide.d4, &wide.d5, &wide.d6, &wide.d7}) {
+                *p = random.real(-1e6, 1e6);
+            }
+            for (std::string *p : {&wide.s0, &wide.s1, &wide.s2, &wide.s3,
+                    &wide.s4, &wide.s5, &wide.s6, &wide.s7}) {
+                *p = random.word(0, 24);
+            }
+            for (bool *p : {&wide.b0, &wide.b1, &wide.b2, &wide.b3,
+                    &wide.b4, &wide.b5, &wide.b6, &wide.b7}) {
+                *p = random.next() & 1;
+            }
+            document.push_back(wide);
+        }
+    }
+    return corpus;
+}
+
+std::vector<LargeMap> maps(Random &random, int documents) {
+    std::vector<LargeMap> corpus(documents);
+    for (auto &document : corpus) {
+        for (int i = 0; i < 2000; i++) {
+            document[random.word(6, 16)] = random.real(-1e9, 1e9);
+        }
+    }
+    return corpus;
+}
+// }}}
+// MEASUREMENT {{{
+struct Result {
+    std::string workload;
+    std::string operation;
+    size_t documents;
+    size_t bytesPerDocument;
+    double mbPerSecond;
+    double nsPerDocument;
+    double allocationsPerDocument;
+    double p50Ns;
+    double p99Ns;
+    std::optional<double> cyclesPerByte;
+    std::optional<double> instructionsPerByte;
+};
+REFLECT(
+    Result, workload, operation, documents, bytesPerDocument, mbPerSecond,
+    nsPerDocument, allocationsPerDocument, p50Ns, p99Ns, cyclesPerByte,
+    instructionsPerByte
+);
+
+struct Report {
+    int rounds;
+    std::vector<Result> results;
+};
+REFLECT(Report, rounds, results);
+
+struct Settings {
+    int rounds = 10;
+    bool perf = false;
+};
+
+// keeps results alive so the optimizer cannot drop the work
+static volatile size_t sink;
+
+// runs `operation` on every document `rounds` times, timing each call
+template <typename F>
+Result measure(
+    const Settings &settings, const char *workload, const char *operation,
+    size_t documents, size_t bytes, F &&run
+) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> samples;
+    samples.reserve(documents * settings.rounds);
+    for (size_t i = 0; i < documents; i++) {
+        run(i);
+    }
+
+    std::optional<PerfCounter> cycles;
+    std::optional<PerfCounter> instructions;
+#if BENCH_PERF
+    if (settings.perf) {
+        cycles.emplace(PERF_COUNT_HW_CPU_CYCLES);
+        instructions.emplace(PERF_COUNT_HW_INSTRUCTIONS);
+        cycles->start();
+        instructions->start();
+    }
+#endif
+    size_t allocationsBefore = allocations;
+    Clock::time_point begin = Clock::now();
+    for (int round = 0; round < settings.rounds; round++) {
+        for (size_t i = 0; i < documents; i++) {
+            Clock::time_point start = Clock::now();
+            run(i);
+            std::chrono::duration<double, std::nano> ns = Clock::now() - start;
+            samples.push_back(ns.count());
+        }
+    }
+    std::chrono::duration<double, std::nano> total = Clock::now() - begin;
+    size_t allocated = allocations - allocationsBefore;
+
+    double calls = (double)samples.size();
+    double totalBytes = (double)bytes * settings.rounds;
+    std::sort(samples.begin(), samples.end());
+    Result result;
+    result.workload = workload;
+    result.operation = operation;
+    result.documents = documents;
+    result.bytesPerDocument = bytes / documents;
+    result.mbPerSecond = totalBytes / total.count() * 1e9 / 1e6;
+    result.nsPerDocument = total.count() / calls;
+    result.allocationsPerDocument = allocated / calls;
+    result.p50Ns = samples[samples.size() / 2];
+    result.p99Ns = samples[samples.size() * 99 / 100];
+    if (settings.perf) {
+        uint64_t cycleCount = cycles->stop();
+        uint64_t instructionCount = instructions->stop();
+        if (cycles->available()) {
+            result.cyclesPerByte = cycleCount / totalBytes;
+        }
+        if (instructions->available()) {
+            result.instructionsPerByte = instructionCount / totalBytes;
+        }
+    }
+    return result;
+}
+
+template <typename T>
+void benchmark(
+    const Settings &settings, Report &report, const char *workload,
+    const std::vector<T> &corpus
+) {
+    std::vector<std::string> documents;
+    size_t bytes = 0;
+    for (const T &document : corpus) {
+        documents.push_back(json::serialize(document));
+        bytes += documents.back().size();
+    }
+    report.results.push_back(measure(
+        settings, workload, "serialize", corpus.size(), bytes,
+        [&](size_t i) {
+            sink = sink + json::serialize(corpus[i]).size();
+        }
+    ));
+    report.results.push_back(measure(
+        settings, workload, "deserialize", corpus.size(), bytes,
+        [&](size_t i) {
+            T document = json::deserialize<T>(documents[i]);
+            sink = sink + (size_t)&document;
+        }
+    ));
+    report.results.push_back(measure(
+        settings, workload, "prettify", corpus.size(), bytes,
+        [&](size_t i) {
+            sink = sink + json::prettify(documents[i]).size();
+        }
+    ));
+}
+// }}}
+
+int main(int argc, char **argv) {
+    Settings settings;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--perf") {
+            settings.perf = true;
+        }
+        else if (arg == "--rounds" && i + 1 < argc) {
+            settings.rounds = std::max(1, atoi(argv[++i]));
+        }
+        else {
+            fprintf(stderr, "usage: %s [--perf] [--rounds N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Random random(0x9e3779b97f4a7c15);
+    Report report;
+    report.rounds = settings.rounds;
+    benchmark(settings, report, "logs", logs(random, 32));
+    benchmark(settings, report, "time series", timeSeries(random, 32));
+    benchmark(settings, report, "nested trees", trees(random, 32));
+    benchmark(settings, report, "wide structs", wides(random, 32));
+    benchmark(settings, report, "large maps", maps(random, 16));
+
+    json::Options options;
+    options.indent = 4;
+    printf("%s\n", json::serialize(report, options).c_str());
+    return 0;
+}
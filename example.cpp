@@ -20,9 +20,10 @@ int main() {
     // create a json string representing the person    
     std::string personJson = json::serialize(person);
 
-    // prettify and print the json string to stdout
-    json::Prettifier prettifier;
-    std::cout << prettifier.prettify(personJson) << std::endl;
+    // print the json indented by 4 spaces to stdout
+    json::Options options;
+    options.indent = 4;
+    std::cout << json::serialize(person, options) << std::endl;
 
     // construct a new person from the person json
     Person person2 = json::deserialize<Person>(personJson);
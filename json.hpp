@@ -1,20 +1,60 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <deque>
+#if __has_include(<flat_map>)
+#include <flat_map>
+#include <flat_set>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#include <limits>
 #include <list>
 #include <map>
 #include <memory>
 #include <optional>
 #include <queue>
 #include <set>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JSON_MMAP 1
+#else
+#define JSON_MMAP 0
+#endif
+#ifdef JSON_INSTRUMENT
+#include <chrono>
+#if defined(JSON_INSTRUMENT_USDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define JSON_USDT 1
+#endif
+#endif
 
 namespace json {
 // CONSTEXPR UTILS {{{
@@ -28,6 +68,15 @@ template <typename T, size_t n>
 constexpr size_t array_size(const T (&)[n]) {
     return n;
 }
+
+// fnv-1a, used to match object keys against reflected field names
+constexpr uint32_t fnv1a(std::string_view string) {
+    uint32_t hash = 2166136261u;
+    for (char c : string) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    return hash;
+}
 // }}}
 // FOR EACH MACRO {{{
 #define PARENS ()
@@ -75,54 +124,644 @@ struct Property
         using _class = CLASS;                                                  \
         return std::tuple{FOR_EACH(REFLECT_PROPERTY, __VA_ARGS__)};            \
     }
+
+template <typename T>
+constexpr bool isReflected() {
+    return !std::is_void<decltype(properties<T>())>::value;
+}
+
+// the `"key":` text our serializer writes before field I of T
+template <typename T, size_t I>
+constexpr auto keyFragment() {
+    constexpr std::string_view key = std::get<I>(properties<T>()).key;
+    std::array<char, key.size() + 3> fragment{};
+    fragment[0] = '"';
+    for (size_t i = 0; i < key.size(); i++) {
+        fragment[i + 1] = key[i];
+    }
+    fragment[key.size() + 1] = '"';
+    fragment[key.size() + 2] = ':';
+    return fragment;
+}
+// policies for leaving fields out of the output, declared next to REFLECT.
+// REFLECT_OMIT(CLASS, POLICY) sets the policy of every field of CLASS and
+// REFLECT_OMIT_FIELDS(CLASS, POLICY, fields...) overrides it for the given
+// fields, OMIT_NEVER forcing them to always be written. when deserializing,
+// an omittable field whose key is missing is reset to the value it is
+// omitted for.
+enum OmitPolicy {
+    OMIT_NEVER = 0,
+    // empty optionals, unique_ptrs and pointers
+    OMIT_NULL = 1,
+    // strings and containers without elements
+    OMIT_EMPTY = 2,
+    // values equal to a value-initialized one
+    OMIT_DEFAULT = 4,
+};
+
+template <typename T>
+constexpr int omitPolicy() {
+    return OMIT_NEVER;
+}
+
+template <typename T, int Policy>
+constexpr auto omitFields() {}
+
+#define REFLECT_OMIT(CLASS, POLICY)                                            \
+    template <>                                                                \
+    constexpr int json::omitPolicy<CLASS>() {                                  \
+        return POLICY;                                                         \
+    }
+
+#define REFLECT_OMIT_FIELD(KEY) &_class::KEY,
+#define REFLECT_OMIT_FIELDS(CLASS, POLICY, ...)                                \
+    template <>                                                                \
+    constexpr auto json::omitFields<CLASS, POLICY>() {                         \
+        using _class = CLASS;                                                  \
+        return std::tuple{FOR_EACH(REFLECT_OMIT_FIELD, __VA_ARGS__)};          \
+    }
+
+// the policy of field I of T, resolved at compile time
+template <typename T, size_t I>
+constexpr int fieldPolicy() {
+    constexpr auto member = std::get<I>(properties<T>()).value;
+    int policy = -1;
+    for_sequence(std::make_integer_sequence<int, 8>{}, [&](auto p) {
+        if constexpr (!std::is_void<decltype(omitFields<T, p>())>::value) {
+            constexpr auto fields = omitFields<T, p>();
+            constexpr auto size = std::tuple_size<decltype(fields)>::value;
+            for_sequence(std::make_index_sequence<size>{}, [&](auto j) {
+                using Field = typename std::decay<decltype(std::get<j>(fields))>::type;
+                using Member = typename std::decay<decltype(member)>::type;
+                if constexpr (std::is_same<Field, Member>().value) {
+                    if (std::get<j>(fields) == member) {
+                        policy = policy < 0 ? p : policy | p;
+                    }
+                }
+            });
+        }
+    });
+    return policy < 0 ? omitPolicy<T>() : policy;
+}
+
+template <int Policy, typename T>
+bool omitValue(const T &value) {
+    if constexpr ((Policy & OMIT_NULL) != 0) {
+        if constexpr (is_specialization<T, std::optional>().value
+                || is_specialization<T, std::unique_ptr>().value
+                || std::is_pointer<T>().value) {
+            if (!value) {
+                return true;
+            }
+        }
+    }
+    if constexpr ((Policy & (OMIT_EMPTY | OMIT_DEFAULT)) != 0) {
+        if constexpr (requires { value.empty(); }) {
+            // a default container is an empty one, and cheaper to test
+            return value.empty();
+        }
+        else if constexpr (std::is_same<T, char *>().value
+                || std::is_same<T, const char *>().value) {
+            if ((Policy & OMIT_EMPTY) && value && !*value) {
+                return true;
+            }
+        }
+    }
+    if constexpr ((Policy & OMIT_DEFAULT) != 0 && !std::is_array<T>().value) {
+        if constexpr (requires { value == T{}; }) {
+            return value == T{};
+        }
+    }
+    return false;
+}
+
+// whether field I of `item` is left out
+template <typename T, size_t I>
+bool omitField(const T &item) {
+    constexpr int policy = fieldPolicy<T, I>();
+    if constexpr (policy != OMIT_NEVER) {
+        return omitValue<policy>(item.*(std::get<I>(properties<T>()).value));
+    }
+    return false;
+}
+
+// the number of fields of `item` that are written
+template <typename T>
+size_t fieldCount(const T &item) {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    size_t count = size;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        if constexpr (fieldPolicy<T, i>() != OMIT_NEVER) {
+            count -= omitField<T, i>(item);
+        }
+    });
+    return count;
+}
+
+// whether omitValue<Policy> can leave out a value of type T
+template <int Policy, typename T>
+constexpr bool omittable() {
+    constexpr bool charPointer = std::is_same<T, char *>().value
+        || std::is_same<T, const char *>().value;
+    if constexpr ((Policy & OMIT_NULL) != 0
+            && (is_specialization<T, std::optional>().value
+                || is_specialization<T, std::unique_ptr>().value
+                || std::is_pointer<T>().value)) {
+        return true;
+    }
+    else if constexpr ((Policy & (OMIT_EMPTY | OMIT_DEFAULT)) != 0
+            && requires (const T &value) { value.empty(); }) {
+        return true;
+    }
+    else if constexpr ((Policy & OMIT_EMPTY) != 0 && charPointer) {
+        return true;
+    }
+    else if constexpr ((Policy & OMIT_DEFAULT) != 0 && !std::is_array<T>().value
+            && requires (const T &value) { value == T{}; }) {
+        return true;
+    }
+    return false;
+}
+
+// sets `value` to one that omitValue<Policy> leaves out
+template <int Policy, typename T>
+void resetValue(T &value) {
+    if constexpr (std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        if constexpr ((Policy & (OMIT_NULL | OMIT_DEFAULT)) != 0) {
+            value = nullptr;
+        }
+        else {
+            // allocated like a deserialized ""
+            value = new char[1]{};
+        }
+    }
+    else if constexpr ((Policy & (OMIT_EMPTY | OMIT_DEFAULT)) != 0
+            && requires { value.clear(); }) {
+        value.clear();
+    }
+    else {
+        value = T{};
+    }
+}
+
+// whether T has a field that may be left out of its output
+template <typename T>
+constexpr bool hasOmittableFields() {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    bool any = false;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        constexpr auto property = std::get<i>(properties<T>());
+        using Type = typename decltype(property)::Type;
+        any = any || omittable<fieldPolicy<T, i>(), Type>();
+    });
+    return any;
+}
+
+// the fields of T found while deserializing it, tracked only when T has
+// omittable fields
+template <typename T>
+using SeenFields = std::array<bool, hasOmittableFields<T>()
+    ? std::tuple_size<decltype(properties<T>())>::value : 0>;
+
+template <typename T, size_t I>
+void markSeen(SeenFields<T> &seen) {
+    if constexpr (std::tuple_size<SeenFields<T>>::value != 0) {
+        seen[I] = true;
+    }
+}
+
+// a missing key means the serializer left the field out, so every
+// omittable field that was not found is reset to the value it was omitted
+// for rather than keeping what the item held before
+template <typename T>
+void resetOmittedFields(T &item, const SeenFields<T> &seen) {
+    if constexpr (std::tuple_size<SeenFields<T>>::value != 0) {
+        constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            constexpr auto property = std::get<i>(properties<T>());
+            constexpr int policy = fieldPolicy<T, i>();
+            using Type = typename decltype(property)::Type;
+            if constexpr (omittable<policy, Type>()) {
+                if (!seen[i]) {
+                    resetValue<policy>(item.*(property.value));
+                }
+            }
+        });
+    }
+}
+
+// a compile-time selection of members of a reflected class, for
+// deserializing only those: json::deserialize<T, json::fields<&T::a>>()
+template <auto... Members>
+struct fields {};
+
+template <auto A, auto B>
+constexpr bool sameMember() {
+    if constexpr (std::is_same<decltype(A), decltype(B)>().value) {
+        return A == B;
+    }
+    return false;
+}
+
+// whether `Member` is one of the REFLECTed fields of T
+template <typename T, auto Member>
+constexpr bool isField() {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    bool found = false;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        found |= sameMember<std::get<i>(properties<T>()).value, Member>();
+    });
+    return found;
+}
+
+// whether field I of T is selected by `fields<Members...>`
+template <typename T, size_t I, auto... Members>
+constexpr bool selectsField(fields<Members...>) {
+    constexpr auto member = std::get<I>(properties<T>()).value;
+    return (sameMember<member, Members>() || ...);
+}
+
+template <typename T, auto... Members>
+constexpr bool isProjection(fields<Members...>) {
+    return (isField<T, Members>() && ...);
+}
 // }}}
-// JSON EXCEPTION {{{
-struct exception {
+// JSON ERRORS {{{
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+#define JSON_EXCEPTIONS 1
+#else
+#define JSON_EXCEPTIONS 0
+#endif
+
+struct error {
     std::string description;
-    int idx;
-    exception(std::string description, int idx) {
-        this->description = description;
-        this->idx = idx;
+    // the byte offset in the input, or -1 without an error
+    int64_t idx = -1;
+
+    explicit operator bool() const {
+        return idx >= 0;
+    }
+};
+
+struct exception : error {
+    exception(std::string description, int64_t idx)
+        : error{std::move(description), idx} {}
+};
+
+[[noreturn]] inline void throwError(const error &err) {
+#if JSON_EXCEPTIONS
+    throw exception(err.description, err.idx);
+#else
+    std::abort();
+#endif
+}
+
+template <typename T>
+struct result {
+    T value{};
+    json::error error;
+
+    bool ok() const {
+        return !error;
+    }
+
+    explicit operator bool() const {
+        return ok();
+    }
+};
+// }}}
+// OPTIONS {{{
+struct Options {
+    // serialize every non-ascii character as a \\u escape
+#ifdef JSON_ENCODE_ASCII
+    bool encodeAscii = true;
+#else
+    bool encodeAscii = false;
+#endif
+    // reject strings containing ill-formed utf-8, in both directions
+#ifdef JSON_VALIDATE_UTF8
+    bool validateUtf8 = true;
+#else
+    bool validateUtf8 = false;
+#endif
+    // pretty print with this many spaces per level, 0 for compact output
+    int indent = 0;
+    // written before each indented line when pretty printing
+    std::string_view newline = "\n";
+    // sort object members by key and write every number in one form, so
+    // that equal values always serialize to the same bytes
+    bool canonical = false;
+};
+// }}}
+// INSTRUMENTATION {{{
+// defining JSON_INSTRUMENT before including this header collects statistics
+// on every serialize and deserialize call. without it the hooks expand to
+// nothing. defining JSON_INSTRUMENT_USDT as well places USDT probes
+// (provider cpp_json) at the entry and exit of each call.
+#ifdef JSON_INSTRUMENT
+namespace instrument {
+
+enum Operation { SERIALIZE, DESERIALIZE };
+
+struct Stats {
+    uint64_t calls = 0;
+    // written when serializing, consumed when deserializing
+    uint64_t bytes = 0;
+    uint64_t nanoseconds = 0;
+    // deepest nesting of arrays and objects
+    int maxDepth = 0;
+    uint64_t strings = 0;
+    uint64_t numbers = 0;
+    // only counted when allocationCount is set
+    uint64_t allocations = 0;
+
+    void add(const Stats &other) {
+        calls += other.calls;
+        bytes += other.bytes;
+        nanoseconds += other.nanoseconds;
+        maxDepth = std::max(maxDepth, other.maxDepth);
+        strings += other.strings;
+        numbers += other.numbers;
+        allocations += other.allocations;
+    }
+};
+
+struct Call {
+    Operation operation;
+    std::string_view type;
+    Stats stats;
+};
+
+// called after every top level serialize or deserialize
+inline void (*onCall)(const Call &call) = nullptr;
+
+// returns the number of allocations so far, for applications counting them
+inline uint64_t (*allocationCount)() = nullptr;
+
+// running totals of the current thread
+struct Counters {
+    int depth = 0;
+    int maxDepth = 0;
+    uint64_t strings = 0;
+    uint64_t numbers = 0;
+};
+
+inline thread_local Counters counters;
+
+template <typename T>
+constexpr std::string_view typeName() {
+    // "... [T = Type]" on clang, "... [with T = Type; ...]" on gcc
+    std::string_view name = __PRETTY_FUNCTION__;
+    size_t start = name.find("T = ") + 4;
+#ifdef __clang__
+    size_t end = name.rfind(']');
+#else
+    size_t end = name.find_first_of(";]", start);
+#endif
+    return name.substr(start, end - start);
+}
+
+// typeName<T>() points into a longer string, the probes need it terminated
+template <typename T>
+inline constexpr auto typeNameStorage = [] {
+    constexpr std::string_view name = typeName<T>();
+    std::array<char, name.size() + 1> storage{};
+    std::copy(name.begin(), name.end(), storage.begin());
+    return storage;
+}();
+
+// the totals of one type on one thread, covering top level calls and every
+// nested reflected class. time is inclusive of nested values.
+struct TypeStats {
+    std::string_view type;
+    Stats serialize;
+    Stats deserialize;
+    TypeStats *next = nullptr;
+};
+
+inline thread_local TypeStats *registered = nullptr;
+
+// registered on first use, so that recording never allocates
+template <typename T>
+TypeStats &statsOf() {
+    static thread_local TypeStats stats;
+    if (stats.type.empty()) {
+        stats.type = std::string_view(
+            typeNameStorage<T>.data(), typeNameStorage<T>.size() - 1);
+        stats.next = registered;
+        registered = &stats;
+    }
+    return stats;
+}
+
+// calls `f(const TypeStats &)` for every type seen on this thread
+template <typename F>
+void forEachType(F &&f) {
+    for (TypeStats *stats = registered; stats; stats = stats->next) {
+        f((const TypeStats &)*stats);
+    }
+}
+
+inline void reset() {
+    for (TypeStats *stats = registered; stats; stats = stats->next) {
+        stats->serialize = Stats();
+        stats->deserialize = Stats();
+    }
+}
+
+inline void enter() {
+    if (++counters.depth > counters.maxDepth) {
+        counters.maxDepth = counters.depth;
+    }
+}
+
+inline void leave() {
+    counters.depth--;
+}
+
+class Scope;
+inline thread_local const Scope *currentScope = nullptr;
+
+class Scope
+{
+    const Scope *m_parent;
+    Operation m_operation;
+    TypeStats &m_stats;
+    bool m_topLevel;
+    uint64_t m_bytes;
+    Counters m_start;
+    uint64_t m_allocations;
+    std::chrono::steady_clock::time_point m_begin;
+
+    // a top level call on a reflected class opens a nested scope on the
+    // same value, which must not be counted a second time
+    bool repeatsParent() const {
+        return !m_topLevel && m_parent && m_parent->m_topLevel
+            && &m_parent->m_stats == &m_stats
+            && m_parent->m_operation == m_operation;
+    }
+
+public:
+    Scope(Operation operation, TypeStats &stats, bool topLevel, uint64_t bytes)
+        : m_parent(currentScope), m_operation(operation), m_stats(stats),
+          m_topLevel(topLevel), m_bytes(bytes), m_start(counters)
+    {
+        currentScope = this;
+        counters.maxDepth = counters.depth;
+        m_allocations = allocationCount ? allocationCount() : 0;
+#ifdef JSON_USDT
+        if (topLevel && operation == SERIALIZE) {
+            DTRACE_PROBE1(cpp_json, serialize__start, stats.type.data());
+        }
+        else if (topLevel) {
+            DTRACE_PROBE1(cpp_json, deserialize__start, stats.type.data());
+        }
+#endif
+        m_begin = std::chrono::steady_clock::now();
+    }
+
+    ~Scope() {
+        currentScope = m_parent;
+    }
+
+    void finish(uint64_t bytes) {
+        auto elapsed = std::chrono::steady_clock::now() - m_begin;
+        Stats stats;
+        stats.calls = 1;
+        stats.bytes = bytes - m_bytes;
+        stats.nanoseconds = std::chrono::duration_cast<
+            std::chrono::nanoseconds>(elapsed).count();
+        stats.maxDepth = counters.maxDepth - m_start.depth;
+        stats.strings = counters.strings - m_start.strings;
+        stats.numbers = counters.numbers - m_start.numbers;
+        if (allocationCount) {
+            stats.allocations = allocationCount() - m_allocations;
+        }
+        // a failed parse may skip leaving the containers it entered
+        counters.depth = m_start.depth;
+        counters.maxDepth = std::max(m_start.maxDepth, counters.maxDepth);
+        if (!repeatsParent()) {
+            (m_operation == SERIALIZE ? m_stats.serialize : m_stats.deserialize)
+                .add(stats);
+        }
+        if (!m_topLevel) {
+            return;
+        }
+#ifdef JSON_USDT
+        if (m_operation == SERIALIZE) {
+            DTRACE_PROBE2(cpp_json, serialize__done, stats.bytes, stats.nanoseconds);
+        }
+        else {
+            DTRACE_PROBE2(cpp_json, deserialize__done, stats.bytes, stats.nanoseconds);
+        }
+#endif
+        if (onCall) {
+            onCall({m_operation, m_stats.type, stats});
+        }
     }
 };
+
+};
+
+#define JSON_INSTRUMENT_BEGIN(operation, T, topLevel, bytes) \
+    json::instrument::Scope jsonInstrumentScope( \
+        json::instrument::operation, json::instrument::statsOf<T>(), \
+        topLevel, bytes)
+#define JSON_INSTRUMENT_END(bytes) jsonInstrumentScope.finish(bytes)
+#define JSON_INSTRUMENT_COUNT(counter) json::instrument::counters.counter++
+#define JSON_INSTRUMENT_ENTER() json::instrument::enter()
+#define JSON_INSTRUMENT_LEAVE() json::instrument::leave()
+#else
+#define JSON_INSTRUMENT_BEGIN(operation, T, topLevel, bytes)
+#define JSON_INSTRUMENT_END(bytes)
+#define JSON_INSTRUMENT_COUNT(counter)
+#define JSON_INSTRUMENT_ENTER()
+#define JSON_INSTRUMENT_LEAVE()
+#endif
 // }}}
 // CURSOR {{{
 struct Cursor
 {
-    const std::string &string;
-    int idx = 0;
+    std::string_view string;
+    int64_t idx = 0;
+    json::error error;
+    Options options;
+    // skip only the whitespace of rfc 8259, without comments
+    bool strict = false;
+
+    Cursor(std::string_view string, const Options &options = Options())
+        : string(string), options(options) {}
+
+    bool failed() const {
+        return (bool)error;
+    }
+
+    bool eof() const {
+        return idx >= (int64_t)string.size();
+    }
+
+    size_t remaining() const {
+        return eof() ? 0 : string.size() - idx;
+    }
+
+    // records the first error and moves to the end of the input so that
+    // every subsequent peek() returns '\0' and all parsing loops unwind.
+    void fail(std::string description) {
+        fail(std::move(description), idx);
+    }
 
-    Cursor(const std::string &string) : string(string) {}
+    void fail(std::string description, int64_t at) {
+        if (!error) {
+            error = {std::move(description), at};
+        }
+        idx = string.size();
+    }
 
     void expect(char c) {
-        if (next() != c) {
+        char got = next();
+        if (got != c) {
             std::string desc = std::string("expected '") + c + "'";
-            desc += std::string(" but got '") + peek(-1) + "'";
-            throw exception(desc, idx);
+            desc += std::string(" but got '") + got + "'";
+            fail(desc);
         }
     }
 
     const char *c_str() {
-        return string.c_str() + idx;
+        return string.data() + idx;
     }
 
-    const char &peek() {
-        return string[idx];
+    char peek() {
+        return idx < (int64_t)string.size() ? string[idx] : '\0';
     }
 
-    const char &peek(int i) {
-        return string[idx + i];
+    char peek(int i) {
+        size_t j = idx + i;
+        return j < string.size() ? string[j] : '\0';
     }
 
-    const char &next() {
-        return string[idx++];
+    char next() {
+        char c = peek();
+        idx++;
+        return c;
     }
 
-    void next(int i) {
+    void next(size_t i) {
         idx += i;
     }
 
     void skipWhitespaceAndComments() {
+        // most values follow their delimiter directly
+        char c = peek();
+        if (c > ' ' && c != '/') {
+            return;
+        }
+        if (strict) {
+            while ((c = peek()) == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                next();
+            }
+            return;
+        }
         while (true) {
             if (isspace(peek())) {
                 next();
@@ -175,14 +814,15 @@ struct Cursor
         return keyword;
     }
 
-    std::string substr(int length) {
+    std::string substr(size_t length) {
         idx += length;
-        return string.substr(idx - length, length);
+        return std::string(string.substr(idx - length, length));
     }
 };
 // }}}
 // UTF-8 {{{
 namespace utf8 {
+// returns 0 if `ch` cannot start a utf-8 sequence
 inline int glyphLen(unsigned char ch) {
     if (ch < 128) {
         return 1;
@@ -196,7 +836,7 @@ inline int glyphLen(unsigned char ch) {
     else if (ch >> 3 == 0b11110) {
         return 4;
     }
-    throw std::exception();
+    return 0;
 }
 
 inline int desurrogatePair(int cp1, int cp2) {
@@ -209,25 +849,46 @@ inline void surrogatePair(int cp, int *s1, int *s2) {
     *s2 = 0xdc00 | (cp & 0x3ff);
 }
 
+constexpr std::array<signed char, 256> hexValues = [] {
+    std::array<signed char, 256> table{};
+    for (int i = 0; i < 256; i++) {
+        table[i] = -1;
+    }
+    for (int i = 0; i < 10; i++) {
+        table['0' + i] = i;
+    }
+    for (int i = 0; i < 6; i++) {
+        table['a' + i] = 10 + i;
+        table['A' + i] = 10 + i;
+    }
+    return table;
+}();
+
+// returns -1 if the four characters are not all hex digits
 inline int parseCodepoint(const char *c) {
-    int cp;
-    char buf[5] = {0};
-    for (int i = 0; i < 4; i++) {
-        switch (*c) {
-            case '0' ... '9':
-            case 'a' ... 'f':
-            case 'A' ... 'F':
-                buf[i] = *c;
-                break;
-            default:
-                throw std::exception();
-        }
-        c++;
+    int h0 = hexValues[(unsigned char)c[0]];
+    int h1 = hexValues[(unsigned char)c[1]];
+    int h2 = hexValues[(unsigned char)c[2]];
+    int h3 = hexValues[(unsigned char)c[3]];
+    if ((h0 | h1 | h2 | h3) < 0) {
+        return -1;
     }
-    sscanf(buf, "%x", &cp);
-    return cp;
+    return (h0 << 12) | (h1 << 8) | (h2 << 4) | h3;
 }
 
+// writes `\\uXXXX` for a codepoint below 0x10000
+inline char *writeEscape(char *out, int cp) {
+    constexpr const char *hex = "0123456789abcdef";
+    out[0] = '\\';
+    out[1] = 'u';
+    out[2] = hex[(cp >> 12) & 0xf];
+    out[3] = hex[(cp >> 8) & 0xf];
+    out[4] = hex[(cp >> 4) & 0xf];
+    out[5] = hex[cp & 0xf];
+    return out + 6;
+}
+
+// returns 0 if `cp` is not a valid codepoint
 inline int codepointToBytes(int cp, char *buf) {
     switch (cp) {
         case 0x0000 ... 0x007F:
@@ -249,10 +910,11 @@ inline int codepointToBytes(int cp, char *buf) {
             buf[3] = 0b10000000 | (0b00111111 & (cp >> 0));
             return 4;
         default:
-            throw std::exception();
+            return 0;
     }
 }
 
+// returns 0 if `buf` does not start with a valid utf-8 lead byte
 inline int bytesToCodepoint(const char *buf, int *cp) {
     int length = glyphLen(*buf);
     switch (length) {
@@ -274,56 +936,873 @@ inline int bytesToCodepoint(const char *buf, int *cp) {
                 (((*(buf + 2)) & 0b00111111) << 6) +
                 (((*(buf + 3)) & 0b00111111) << 0);
             break;
+    }
+    return length;
+}
+
+// returns the length of the well-formed utf-8 sequence starting at `p`,
+// or 0 if it is truncated, overlong, a surrogate or above U+10FFFF.
+inline int sequenceLength(const char *p, const char *end) {
+    const unsigned char *s = (const unsigned char *)p;
+    size_t avail = end - p;
+    auto cont = [&](size_t i, unsigned char lo, unsigned char hi) {
+        return i < avail && s[i] >= lo && s[i] <= hi;
+    };
+    switch (s[0]) {
+        case 0x00 ... 0x7F:
+            return 1;
+        case 0xC2 ... 0xDF:
+            return cont(1, 0x80, 0xBF) ? 2 : 0;
+        case 0xE0:
+            return cont(1, 0xA0, 0xBF) && cont(2, 0x80, 0xBF) ? 3 : 0;
+        case 0xE1 ... 0xEC:
+        case 0xEE ... 0xEF:
+            return cont(1, 0x80, 0xBF) && cont(2, 0x80, 0xBF) ? 3 : 0;
+        case 0xED:
+            return cont(1, 0x80, 0x9F) && cont(2, 0x80, 0xBF) ? 3 : 0;
+        case 0xF0:
+            return cont(1, 0x90, 0xBF) && cont(2, 0x80, 0xBF)
+                && cont(3, 0x80, 0xBF) ? 4 : 0;
+        case 0xF1 ... 0xF3:
+            return cont(1, 0x80, 0xBF) && cont(2, 0x80, 0xBF)
+                && cont(3, 0x80, 0xBF) ? 4 : 0;
+        case 0xF4:
+            return cont(1, 0x80, 0x8F) && cont(2, 0x80, 0xBF)
+                && cont(3, 0x80, 0xBF) ? 4 : 0;
         default:
-            throw std::exception();
+            return 0;
+    }
+}
+
+// returns a pointer to the first ill-formed sequence, or `end`
+inline const char *validate(const char *p, const char *end) {
+    while (p < end) {
+        if ((unsigned char)*p < 0x80) {
+            p++;
+            continue;
+        }
+        int length = sequenceLength(p, end);
+        if (!length) {
+            return p;
+        }
+        p += length;
+    }
+    return end;
+}
+
+// decodes the well-formed sequence at `p` into `*cp`, returning its length
+// or 0 if it is ill-formed
+inline int decode(const char *p, const char *end, int *cp) {
+    const unsigned char *s = (const unsigned char *)p;
+    int length = sequenceLength(p, end);
+    switch (length) {
+        case 1:
+            *cp = s[0];
+            break;
+        case 2:
+            *cp = ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+            break;
+        case 3:
+            *cp = ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6)
+                | (s[2] & 0x3f);
+            break;
+        case 4:
+            *cp = ((s[0] & 0x07) << 18) | ((s[1] & 0x3f) << 12)
+                | ((s[2] & 0x3f) << 6) | (s[3] & 0x3f);
+            break;
     }
     return length;
 }
 
-inline std::string escapeCodepoint(const char *str, int *offset) {
-    int cp;
-    *offset += utf8::bytesToCodepoint(str + *offset, &cp) - 1;
-    char buf[16];
+// writes `cp` as one \\u escape, or a surrogate pair of them
+inline char *escapeCodepoint(char *out, int cp) {
     if (cp < 0x10000) {
-        snprintf(buf, sizeof(buf), "\\u%.4x", cp);
-        return std::string(buf, 6);
-    }
-    else {
-        int s1, s2;
-        utf8::surrogatePair(cp, &s1, &s2);
-        snprintf(buf, sizeof(buf), "\\u%.4x\\u%.4x", s1, s2);
-        return std::string(buf, 12);
+        return writeEscape(out, cp);
     }
+    int s1, s2;
+    utf8::surrogatePair(cp, &s1, &s2);
+    return writeEscape(writeEscape(out, s1), s2);
 }
 
-inline std::string unescapeCodepoint(Cursor &cursor) {
+// decodes the \\u escape at the cursor, and the second half of a surrogate
+// pair, into `buf`. returns the number of bytes written, 0 on failure.
+inline int unescapeCodepoint(Cursor &cursor, char *buf) {
+    // copy the ten characters a surrogate pair may span after the 'u', so
+    // the hex digits can be looked up without bounds checks
+    char hex[10] = {0};
+    size_t avail = cursor.string.size() - cursor.idx - 1;
+    memcpy(hex, cursor.c_str() + 1, avail < sizeof(hex) ? avail : sizeof(hex));
     cursor.next();
-    int cp = utf8::parseCodepoint(cursor.c_str());
+    int cp = utf8::parseCodepoint(hex);
+    if (cp < 0) {
+        cursor.fail("invalid utf-8 codepoint");
+        return 0;
+    }
     cursor.next(3);
     if (0xd800 <= cp && cp <= 0xdbff) {
-        if (cursor.peek(1) != '\\' || cursor.peek(2) != 'u') {
-            throw exception("expected utf-8 surrogate pair", cursor.idx);
+        if (hex[4] != '\\' || hex[5] != 'u') {
+            cursor.fail("expected utf-8 surrogate pair");
+            return 0;
         }
-        int cp2 = utf8::parseCodepoint(cursor.c_str() + 3);
+        int cp2 = utf8::parseCodepoint(hex + 6);
         if (!(0xdc00 <= cp2 && cp2 <= 0xdfff)) {
-            throw exception("invalid utf-8 surrogate pair", cursor.idx);
+            cursor.fail("invalid utf-8 surrogate pair");
+            return 0;
         }
         cp = utf8::desurrogatePair(cp, cp2);
         cursor.next(6);
     }
-    if (cp > 0x10FFFF) {
-        throw exception("invalid utf-8 codepoint", cursor.idx);
+    int size = utf8::codepointToBytes(cp, buf);
+    if (!size) {
+        cursor.fail("invalid utf-8 codepoint");
     }
+    return size;
+}
+
+inline void unescapeCodepoint(Cursor &cursor, std::string &out) {
     char buf[4];
-    int size = utf8::codepointToBytes(cp, buf);
-    return std::string(buf, size);
+    int size = unescapeCodepoint(cursor, buf);
+    out.append(buf, size);
 }
 };
 // }}}
-// JSON BUILDERS {{{
-class JsonArrayBuilder
+// SIMD {{{
+namespace simd {
+enum ScanFlags {
+    // stop at control characters and DEL, which must be escaped on output
+    STOP_CONTROL = 1,
+    // stop at every byte >= 0x80, used when escaping to ascii
+    STOP_NON_ASCII = 2,
+    // check that the skipped bytes are well-formed utf-8
+    VALIDATE_UTF8 = 4,
+};
+
+#ifdef __SSSE3__
+// the lookup-table utf-8 validator by keiser & lemire: three nibble lookups
+// classify every byte pair and a shifted compare checks the multi-byte
+// lengths, 16 bytes at a time.
+class Utf8Checker
 {
-    std::string m_buffer;
+    __m128i m_error = _mm_setzero_si128();
+    __m128i m_prev = _mm_setzero_si128();
+    __m128i m_prevIncomplete = _mm_setzero_si128();
+
+    static __m128i high(__m128i v) {
+        return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+    }
+
+    static __m128i lookup(__m128i table, __m128i idx) {
+        return _mm_shuffle_epi8(table, idx);
+    }
+
+public:
+    void check(__m128i input) {
+        if (_mm_movemask_epi8(input) == 0) {
+            m_error = _mm_or_si128(m_error, m_prevIncomplete);
+            m_prev = input;
+            m_prevIncomplete = _mm_setzero_si128();
+            return;
+        }
+        constexpr char TOO_SHORT = 1 << 0;
+        constexpr char TOO_LONG = 1 << 1;
+        constexpr char OVERLONG_3 = 1 << 2;
+        constexpr char TOO_LARGE = 1 << 3;
+        constexpr char SURROGATE = 1 << 4;
+        constexpr char OVERLONG_2 = 1 << 5;
+        constexpr char TOO_LARGE_1000 = 1 << 6;
+        constexpr char OVERLONG_4 = 1 << 6;
+        constexpr char TWO_CONTS = (char)(1 << 7);
+        constexpr char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+        __m128i prev1 = _mm_alignr_epi8(input, m_prev, 15);
+        __m128i byte1High = lookup(_mm_setr_epi8(
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2,
+            TOO_SHORT,
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+        ), high(prev1));
+        __m128i byte1Low = lookup(_mm_setr_epi8(
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            CARRY | OVERLONG_2,
+            CARRY,
+            CARRY,
+            CARRY | TOO_LARGE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000
+        ), _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+        __m128i byte2High = lookup(_mm_setr_epi8(
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000
+                | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+        ), high(input));
+        __m128i special = _mm_and_si128(
+            _mm_and_si128(byte1High, byte1Low), byte2High);
+
+        // bytes two and three after a 3 or 4 byte lead must be continuations
+        __m128i prev2 = _mm_alignr_epi8(input, m_prev, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, m_prev, 13);
+        __m128i isThird = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+        __m128i isFourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80));
+        __m128i must23 = _mm_and_si128(
+            _mm_or_si128(isThird, isFourth), _mm_set1_epi8((char)0x80));
+        m_error = _mm_or_si128(m_error, _mm_xor_si128(must23, special));
+
+        m_prevIncomplete = _mm_subs_epu8(input, _mm_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+        ));
+        m_prev = input;
+    }
+
+    bool finish() {
+        m_error = _mm_or_si128(m_error, m_prevIncomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(
+            m_error, _mm_setzero_si128())) == 0xFFFF;
+    }
+};
+#endif
+
+#ifdef __SSE2__
+inline __m128i specialBytes(__m128i v, int flags) {
+    __m128i special = _mm_or_si128(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    if (flags & STOP_CONTROL) {
+        __m128i control = _mm_cmpeq_epi8(
+            _mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+        special = _mm_or_si128(special, control);
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_set1_epi8(127)));
+    }
+    if (flags & STOP_NON_ASCII) {
+        special = _mm_or_si128(special, _mm_cmplt_epi8(v, _mm_setzero_si128()));
+    }
+    return special;
+}
+#endif
+
+inline bool isSpecialByte(unsigned char c, int flags) {
+    if (c == '"' || c == '\\') {
+        return true;
+    }
+    if ((flags & STOP_CONTROL) && (c < 0x20 || c == 127)) {
+        return true;
+    }
+    return (flags & STOP_NON_ASCII) && c >= 0x80;
+}
+
+// returns a pointer to the first '"' or '\\' in [p, end), or to the first
+// byte excluded by `flags`, or `end`. with VALIDATE_UTF8 the skipped run is
+// checked in the same pass and `*invalid` points at its first ill-formed
+// sequence, if any.
+inline const char *scanString(
+    const char *p, const char *end, int flags, const char **invalid
+) {
+    const char *start = p;
+    bool validate = (flags & VALIDATE_UTF8) && !(flags & STOP_NON_ASCII);
+#ifdef __SSE2__
+#ifdef __SSSE3__
+    Utf8Checker checker;
+#endif
+    int suspect = 0;
+    while (true) {
+        __m128i v;
+        size_t avail = end - p;
+        if (avail >= 16) {
+            v = _mm_loadu_si128((const __m128i *)p);
+        }
+        else {
+            alignas(16) char tail[16] = {0};
+            memcpy(tail, p, avail);
+            v = _mm_load_si128((const __m128i *)tail);
+        }
+        int mask = _mm_movemask_epi8(specialBytes(v, flags));
+        if (avail < 16) {
+            mask &= (1 << avail) - 1;
+        }
+        int stop = mask ? __builtin_ctz(mask) : (avail < 16 ? avail : 16);
+        if (validate && stop < 16) {
+            static const char keep[32] = {
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            };
+            v = _mm_and_si128(v, _mm_loadu_si128(
+                (const __m128i *)(keep + 16 - stop)));
+        }
+        if (validate) {
+#ifdef __SSSE3__
+            checker.check(v);
+#else
+            suspect |= _mm_movemask_epi8(v);
+#endif
+        }
+        if (stop < 16 || avail == 16) {
+            p += stop;
+            break;
+        }
+        p += 16;
+    }
+#ifdef __SSSE3__
+    suspect = validate && !checker.finish();
+#endif
+    if (suspect) {
+        const char *bad = utf8::validate(start, p);
+        if (bad != p) {
+            *invalid = bad;
+        }
+    }
+#else
+    while (p < end && !isSpecialByte(*p, flags)) {
+        p++;
+    }
+    if (validate) {
+        const char *bad = utf8::validate(start, p);
+        if (bad != p) {
+            *invalid = bad;
+        }
+    }
+#endif
+    return p;
+}
+
+// returns a pointer to the first ascii byte in [p, end), or `end`
+inline const char *skipNonAscii(const char *p, const char *end) {
+#ifdef __SSE2__
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int ascii = ~_mm_movemask_epi8(v) & 0xFFFF;
+        if (ascii) {
+            return p + __builtin_ctz(ascii);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && (unsigned char)*p >= 0x80) {
+        p++;
+    }
+    return p;
+}
+
+// returns a pointer to the first byte in [p, end) that is not a space, tab,
+// carriage return or newline, or `end`
+inline const char *skipWhitespace(const char *p, const char *end) {
+#ifdef __SSE2__
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        int other = ~_mm_movemask_epi8(space) & 0xFFFF;
+        if (other) {
+            return p + __builtin_ctz(other);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// returns an upper bound on the number of elements of a flat array whose
+// contents start at `p`, by counting commas up to the first ']'
+inline size_t countArrayElements(const char *p, const char *end) {
+    size_t commas = 0;
+#ifdef __SSE2__
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int close = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+        int comma = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+        if (close) {
+            return commas + __builtin_popcount(comma & ((close & -close) - 1)) + 1;
+        }
+        commas += __builtin_popcount(comma);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ']') {
+        commas += *p++ == ',';
+    }
+    return commas + 1;
+}
+
+// returns an upper bound on the number of elements or members of the array
+// or object whose contents start at `p`, by counting the commas outside of
+// strings and nested values up to its closing bracket
+inline size_t countElements(const char *p, const char *end) {
+    size_t commas = 0;
+    int depth = 0;
+    for (; p < end; p++) {
+        switch (*p) {
+            case '"':
+                for (p++; p < end && *p != '"'; p++) {
+                    p += *p == '\\';
+                }
+                break;
+            case '[':
+            case '{':
+                depth++;
+                break;
+            case ']':
+            case '}':
+                if (!depth--) {
+                    return commas + 1;
+                }
+                break;
+            case ',':
+                commas += !depth;
+                break;
+        }
+    }
+    return commas + 1;
+}
+
+// returns the end of the value at `p` by matching brackets and quotes,
+// without checking anything else. strings are skipped 16 bytes at a time.
+inline const char *skipValue(const char *p, const char *end) {
+    int depth = 0;
+    while (p < end) {
+        switch (*p) {
+            case '"': {
+                const char *invalid = nullptr;
+                for (p++; (p = scanString(p, end, 0, &invalid)) < end;) {
+                    if (*p == '"') {
+                        break;
+                    }
+                    // the escape may be cut off by the end of the input
+                    p += 2;
+                    if (p >= end) {
+                        return end;
+                    }
+                }
+                if (p >= end) {
+                    return end;
+                }
+                p++;
+                if (!depth) {
+                    return p;
+                }
+                continue;
+            }
+            case '[':
+            case '{':
+                depth++;
+                break;
+            case ']':
+            case '}':
+                if (!depth) {
+                    return p;
+                }
+                if (!--depth) {
+                    return p + 1;
+                }
+                break;
+            case '/':
+                if (p + 1 < end && p[1] == '/') {
+                    p = (const char *)memchr(p, '\n', end - p);
+                    p = p ? p : end;
+                    continue;
+                }
+                if (p + 1 < end && p[1] == '*') {
+                    const char *close = p + 2;
+                    while (close + 1 < end && !(close[0] == '*' && close[1] == '/')) {
+                        close++;
+                    }
+                    p = close + 2 < end ? close + 2 : end;
+                    continue;
+                }
+                if (!depth) {
+                    return p;
+                }
+                break;
+            case ',':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                // the end of a number or keyword
+                if (!depth) {
+                    return p;
+                }
+                break;
+        }
+        p++;
+    }
+    return p;
+}
+};
+// }}}
+// BASE64 {{{
+// the standard alphabet with padding, as used by json::bytes
+namespace base64 {
+inline constexpr char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// the value of each character, or -1 outside the alphabet
+inline constexpr std::array<int8_t, 256> VALUES = [] {
+    std::array<int8_t, 256> values{};
+    for (int8_t &value : values) {
+        value = -1;
+    }
+    for (int i = 0; i < 64; i++) {
+        values[(unsigned char)ALPHABET[i]] = i;
+    }
+    return values;
+}();
+
+constexpr size_t encodedSize(size_t size) {
+    return (size + 2) / 3 * 4;
+}
+
+// writes the padded encoding of `size` bytes to `out`, returning its end
+inline char *encode(const uint8_t *data, size_t size, char *out) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+#ifdef __SSSE3__
+    // the pshufb encoder by mula & lemire: spread 12 bytes over 16 lanes of
+    // 6 bits each, then map each range of values to its offset in ascii
+    const __m128i spread = _mm_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i offsets = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+    while (end - p >= 16) {
+        __m128i in = _mm_shuffle_epi8(
+            _mm_loadu_si128((const __m128i *)p), spread);
+        __m128i high = _mm_mulhi_epu16(
+            _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+            _mm_set1_epi32(0x04000040));
+        __m128i low = _mm_mullo_epi16(
+            _mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+            _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(high, low);
+        // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+        __m128i chars = _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+        _mm_storeu_si128((__m128i *)out, chars);
+        out += 16;
+        p += 12;
+    }
+#endif
+    for (; end - p >= 3; p += 3) {
+        uint32_t n = p[0] << 16 | p[1] << 8 | p[2];
+        *out++ = ALPHABET[n >> 18];
+        *out++ = ALPHABET[n >> 12 & 63];
+        *out++ = ALPHABET[n >> 6 & 63];
+        *out++ = ALPHABET[n & 63];
+    }
+    if (end - p == 1) {
+        *out++ = ALPHABET[p[0] >> 2];
+        *out++ = ALPHABET[(p[0] & 3) << 4];
+        *out++ = '=';
+        *out++ = '=';
+    }
+    else if (end - p == 2) {
+        *out++ = ALPHABET[p[0] >> 2];
+        *out++ = ALPHABET[(p[0] & 3) << 4 | p[1] >> 4];
+        *out++ = ALPHABET[(p[1] & 15) << 2];
+        *out++ = '=';
+    }
+    return out;
+}
+
+// the number of bytes encoded by `size` characters, with or without
+// padding, or SIZE_MAX if no encoding has that length
+inline size_t decodedSize(const char *data, size_t size) {
+    if (size % 4 == 0 && size && data[size - 1] == '=') {
+        size -= data[size - 2] == '=' ? 2 : 1;
+    }
+    if (size % 4 == 1) {
+        return SIZE_MAX;
+    }
+    return size / 4 * 3 + (size % 4 ? size % 4 - 1 : 0);
+}
+
+// decodes `size` characters into the decodedSize() bytes at `out`. returns
+// nullptr on success or the first character outside the alphabet.
+inline const char *decode(const char *data, size_t size, uint8_t *out) {
+    if (size % 4 == 0 && size && data[size - 1] == '=') {
+        size -= data[size - 2] == '=' ? 2 : 1;
+    }
+    const char *p = data;
+    const char *end = data + size;
+#ifdef __SSSE3__
+    // the pshufb decoder by mula & lemire: the high nibble of each character
+    // selects its offset from ascii and a bit in a mask indexed by the low
+    // nibble says whether it is in the alphabet at all
+    const __m128i offsets = _mm_setr_epi8(
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i masks = _mm_setr_epi8(
+        (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+        (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bits = _mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    while (end - p >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)p);
+        __m128i high = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+        __m128i low = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+        __m128i valid = _mm_and_si128(
+            _mm_shuffle_epi8(masks, low), _mm_shuffle_epi8(bits, high));
+        int invalid = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(valid, _mm_setzero_si128()));
+        if (invalid) {
+            return p + __builtin_ctz(invalid);
+        }
+        // '/' shares its high nibble with '+' but not its offset
+        __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+        __m128i offset = _mm_or_si128(
+            _mm_andnot_si128(slash, _mm_shuffle_epi8(offsets, high)),
+            _mm_and_si128(slash, _mm_set1_epi8(16)));
+        __m128i values = _mm_add_epi8(in, offset);
+        // merge pairs of 6 bits into 12, then pairs of 12 into 24
+        __m128i merged = _mm_madd_epi16(
+            _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)),
+            _mm_set1_epi32(0x00011000));
+        uint8_t block[16];
+        _mm_storeu_si128((__m128i *)block, _mm_shuffle_epi8(merged, pack));
+        memcpy(out, block, 12);
+        out += 12;
+        p += 16;
+    }
+#endif
+    uint32_t n = 0;
+    int count = 0;
+    for (; p < end; p++) {
+        int8_t value = VALUES[(unsigned char)*p];
+        if (value < 0) {
+            return p;
+        }
+        n = n << 6 | value;
+        if (++count == 4) {
+            *out++ = n >> 16;
+            *out++ = n >> 8;
+            *out++ = n;
+            n = 0;
+            count = 0;
+        }
+    }
+    if (count == 2) {
+        *out++ = n >> 4;
+    }
+    else if (count == 3) {
+        *out++ = n >> 10;
+        *out++ = n >> 2;
+    }
+    return nullptr;
+}
+};
+
+// a byte buffer that serializes as a base64 string rather than an array of
+// numbers. binary formats store it as raw bytes.
+struct bytes : std::vector<uint8_t> {
+    using std::vector<uint8_t>::vector;
+};
+// }}}
+// WRITER {{{
+// an append-only output buffer shared by every serializer in a call, along
+// with the options of that call. constructed with a sink, the buffer has a
+// fixed size and is handed to the sink each time it fills up.
+class Writer
+{
+    static constexpr size_t SINK_BUFFER_SIZE = 1 << 16;
+
+    std::string m_buffer;
+    // the start of m_buffer, or of a buffer owned by the caller
+    char *m_data;
+    char *m_pos;
+    char *m_end;
+    int m_depth = 0;
+    uint64_t m_flushed = 0;
+    void (*m_sink)(void *context, const char *data, size_t size) = nullptr;
+    void *m_sinkContext = nullptr;
+
+    void grow(size_t n) {
+        if (m_sink) {
+            flush();
+            if (n <= (size_t)(m_end - m_data)) {
+                return;
+            }
+        }
+        // a sink has just been flushed, so only growth mode copies
+        size_t used = m_pos - m_data;
+        size_t size = (m_end - m_data) * 2;
+        if (size < used + n + 64) {
+            size = used + n + 64;
+        }
+        // small documents fit in the first allocation
+        if (size < 256) {
+            size = 256;
+        }
+        m_buffer.resize(size);
+        m_data = m_buffer.data();
+        m_pos = m_data + used;
+        m_end = m_data + m_buffer.size();
+    }
+
+public:
+    Options options;
+    // the fields of the class being written, from a field_mask
+    const int32_t *mask = nullptr;
+
+    Writer(const Options &options = Options()) : options(options) {
+        m_data = m_pos = m_end = m_buffer.data();
+    }
+
+    // `sink(const char *data, size_t size)` receives the output in order
+    template <typename Sink>
+        requires std::is_invocable<Sink &, const char *, size_t>::value
+    Writer(Sink &sink, const Options &options = Options()) : options(options) {
+        m_sink = [](void *context, const char *data, size_t size) {
+            (*(Sink *)context)(data, size);
+        };
+        m_sinkContext = &sink;
+        m_buffer.resize(SINK_BUFFER_SIZE);
+        m_data = m_pos = m_buffer.data();
+        m_end = m_pos + m_buffer.size();
+    }
+
+    // buffers the output for the sink in `buffer` rather than allocating
+    template <typename Sink>
+        requires std::is_invocable<Sink &, const char *, size_t>::value
+    Writer(
+        Sink &sink, char *buffer, size_t size,
+        const Options &options = Options()
+    ) : Writer(options) {
+        m_sink = [](void *context, const char *data, size_t size) {
+            (*(Sink *)context)(data, size);
+        };
+        m_sinkContext = &sink;
+        m_data = m_pos = buffer;
+        m_end = buffer + size;
+    }
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    void put(char c) {
+        if (m_pos == m_end) {
+            grow(1);
+        }
+        *m_pos++ = c;
+    }
+
+    void write(const char *data, size_t size) {
+        if ((size_t)(m_end - m_pos) < size) {
+            if (m_sink && size >= (size_t)(m_end - m_data)) {
+                flush();
+                m_sink(m_sinkContext, data, size);
+                m_flushed += size;
+                return;
+            }
+            grow(size);
+        }
+        if (size) {
+            memcpy(m_pos, data, size);
+        }
+        m_pos += size;
+    }
+
+    void write(std::string_view data) {
+        write(data.data(), data.size());
+    }
+
+    // returns space for at least `size` more bytes. once filled, hand the
+    // end of the written bytes back to advance().
+    char *reserve(size_t size) {
+        if ((size_t)(m_end - m_pos) < size) {
+            grow(size);
+        }
+        return m_pos;
+    }
+
+    void advance(char *pos) {
+        m_pos = pos;
+    }
+
+    // hands everything buffered so far to the sink
+    void flush() {
+        if (m_sink && m_pos != m_data) {
+            m_sink(m_sinkContext, m_data, m_pos - m_data);
+            m_flushed += m_pos - m_data;
+            m_pos = m_data;
+        }
+    }
+
+    size_t size() const {
+        return m_pos - m_data;
+    }
+
+    // bytes written so far, including those already handed to the sink
+    uint64_t written() const {
+        return m_flushed + size();
+    }
+
+    bool pretty() const {
+        return options.indent > 0;
+    }
+
+    void indent() {
+        m_depth++;
+    }
+
+    void dedent() {
+        m_depth--;
+    }
+
+    // starts a new line at the current depth when pretty printing
+    void newline() {
+        if (!pretty()) {
+            return;
+        }
+        static const std::string padding(256, ' ');
+        write(options.newline);
+        size_t width = m_depth > 0 ? (size_t)m_depth * options.indent : 0;
+        while (width) {
+            size_t chunk = width < padding.size() ? width : padding.size();
+            write(padding.data(), chunk);
+            width -= chunk;
+        }
+    }
+
+    std::string take() {
+        m_buffer.resize(size());
+        std::string result = std::move(m_buffer);
+        m_buffer = std::string();
+        m_data = m_pos = m_end = m_buffer.data();
+        return result;
+    }
+};
+// }}}
+// JSON BUILDERS {{{
+class JsonArrayBuilder
+{
+    std::string m_buffer;
 
 public:
     void add(std::string item) {
@@ -374,6 +1853,92 @@ public:
         return m_buffer;
     }
 };
+
+class JsonArrayWriter
+{
+    Writer &m_writer;
+    bool m_first = true;
+
+public:
+    JsonArrayWriter(Writer &writer) : m_writer(writer) {}
+
+    void start() {
+        m_writer.put('[');
+        m_writer.indent();
+        JSON_INSTRUMENT_ENTER();
+    }
+
+    void finish() {
+        JSON_INSTRUMENT_LEAVE();
+        m_writer.dedent();
+        if (!m_first) {
+            m_writer.newline();
+        }
+        m_writer.put(']');
+    }
+
+    void next() {
+        if (!m_first) {
+            m_writer.put(',');
+        }
+        m_first = false;
+        m_writer.newline();
+    }
+};
+
+class JsonObjectWriter
+{
+    Writer &m_writer;
+    bool m_first = true;
+
+public:
+    JsonObjectWriter(Writer &writer) : m_writer(writer) {}
+
+    void start() {
+        m_writer.put('{');
+        m_writer.indent();
+        JSON_INSTRUMENT_ENTER();
+    }
+
+    void finish() {
+        JSON_INSTRUMENT_LEAVE();
+        m_writer.dedent();
+        if (!m_first) {
+            m_writer.newline();
+        }
+        m_writer.put('}');
+    }
+
+    void next() {
+        if (!m_first) {
+            m_writer.put(',');
+        }
+        m_first = false;
+        m_writer.newline();
+    }
+
+    // writes a key that needs no escaping, and the following ':'
+    void quotedKey(std::string_view key) {
+        next();
+        char *out = m_writer.reserve(key.size() + 4);
+        *out++ = '"';
+        memcpy(out, key.data(), key.size());
+        out += key.size();
+        *out++ = '"';
+        *out++ = ':';
+        if (m_writer.pretty()) {
+            *out++ = ' ';
+        }
+        m_writer.advance(out);
+    }
+
+    void value() {
+        m_writer.put(':');
+        if (m_writer.pretty()) {
+            m_writer.put(' ');
+        }
+    }
+};
 // }}}
 // JSON PARSERS {{{
 class JsonArrayParser
@@ -387,21 +1952,25 @@ public:
     void start() {
         m_cursor.skipWhitespaceAndComments();
         m_cursor.expect('[');
+        JSON_INSTRUMENT_ENTER();
     }
 
     void finish() {
+        JSON_INSTRUMENT_LEAVE();
         m_cursor.skipWhitespaceAndComments();
         m_cursor.expect(']');
     }
 
     bool optionalNext() {
         m_cursor.skipWhitespaceAndComments();
-        if (m_cursor.peek() == ']') {
+        if (m_cursor.peek() == ']' || m_cursor.failed()) {
             return false;
         }
-        m_cursor.skipWhitespaceAndComments();
         if (!m_first) {
             m_cursor.expect(',');
+            if (m_cursor.failed()) {
+                return false;
+            }
         }
         m_cursor.skipWhitespaceAndComments();
         m_first = false;
@@ -410,7 +1979,7 @@ public:
 
     void next() {
         if (!optionalNext()) {
-            throw exception("not enough elements in array", m_cursor.idx);
+            m_cursor.fail("not enough elements in array");
         }
     }
 };
@@ -426,21 +1995,25 @@ public:
     void start() {
         m_cursor.skipWhitespaceAndComments();
         m_cursor.expect('{');
+        JSON_INSTRUMENT_ENTER();
     }
 
     void finish() {
+        JSON_INSTRUMENT_LEAVE();
         m_cursor.skipWhitespaceAndComments();
         m_cursor.expect('}');
     }
 
     bool optionalNext() {
         m_cursor.skipWhitespaceAndComments();
-        if (m_cursor.peek() == '}') {
+        if (m_cursor.peek() == '}' || m_cursor.failed()) {
             return false;
         }
-        m_cursor.skipWhitespaceAndComments();
         if (!m_first) {
             m_cursor.expect(',');
+            if (m_cursor.failed()) {
+                return false;
+            }
         }
         m_cursor.skipWhitespaceAndComments();
         m_first = false;
@@ -449,7 +2022,7 @@ public:
 
     void next() {
         if (!optionalNext()) {
-            throw exception("not enough elements in object", m_cursor.idx);
+            m_cursor.fail("not enough elements in object");
         }
     }
 
@@ -460,324 +2033,1144 @@ public:
     }
 };
 // }}}
-// SERIALIZE {{{
-template <typename T>
-std::string serialize(const T &item);
+// FLAT CONTAINERS {{{
+// sorted vectors with the interface of std::map and std::set, which keep
+// their elements contiguous for cheap lookups and iteration. std::flat_map
+// and std::flat_set are supported too where the standard library has them.
 
-template <typename T>
-std::string serializeUniquePointer(const std::unique_ptr<T> &item) {
-    if (item) {
-        return serialize(*item);
+// sorts `items` by `key` unless they are sorted already, then keeps the last
+// of each run of equal keys, as json does with repeated keys
+template <typename T, typename Key, typename Compare>
+void sortUnique(std::vector<T> &items, Key key, Compare compare) {
+    auto less = [&](const T &lhs, const T &rhs) {
+        return compare(key(lhs), key(rhs));
+    };
+    if (!std::is_sorted(items.begin(), items.end(), less)) {
+        std::stable_sort(items.begin(), items.end(), less);
     }
-    else {
-        return "null";
+    size_t size = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i + 1 < items.size() && !less(items[i], items[i + 1])) {
+            continue;
+        }
+        if (size != i) {
+            items[size] = std::move(items[i]);
+        }
+        size++;
     }
+    items.erase(items.begin() + size, items.end());
 }
 
-template <typename T>
-std::string serializeOptional(const std::optional<T> &item) {
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class flat_map
+{
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+    using key_compare = Compare;
+    using container_type = std::vector<value_type>;
+    using iterator = typename container_type::iterator;
+    using const_iterator = typename container_type::const_iterator;
+
+private:
+    container_type m_items;
+    Compare m_compare;
+
+    static const Key &keyOf(const value_type &item) {
+        return item.first;
+    }
+
+public:
+    flat_map() = default;
+
+    flat_map(std::initializer_list<value_type> items) : m_items(items) {
+        sortUnique(m_items, keyOf, m_compare);
+    }
+
+    iterator begin() {
+        return m_items.begin();
+    }
+
+    iterator end() {
+        return m_items.end();
+    }
+
+    const_iterator begin() const {
+        return m_items.begin();
+    }
+
+    const_iterator end() const {
+        return m_items.end();
+    }
+
+    size_t size() const {
+        return m_items.size();
+    }
+
+    bool empty() const {
+        return m_items.empty();
+    }
+
+    void clear() {
+        m_items.clear();
+    }
+
+    void reserve(size_t size) {
+        m_items.reserve(size);
+    }
+
+    key_compare key_comp() const {
+        return m_compare;
+    }
+
+    iterator lower_bound(const Key &key) {
+        return std::lower_bound(m_items.begin(), m_items.end(), key,
+            [&](const value_type &item, const Key &key) {
+                return m_compare(item.first, key);
+            });
+    }
+
+    const_iterator lower_bound(const Key &key) const {
+        return const_cast<flat_map *>(this)->lower_bound(key);
+    }
+
+    iterator find(const Key &key) {
+        iterator it = lower_bound(key);
+        return it != end() && !m_compare(key, it->first) ? it : end();
+    }
+
+    const_iterator find(const Key &key) const {
+        return const_cast<flat_map *>(this)->find(key);
+    }
+
+    size_t count(const Key &key) const {
+        return find(key) != end();
+    }
+
+    bool contains(const Key &key) const {
+        return find(key) != end();
+    }
+
+    Value &at(const Key &key) {
+        iterator it = find(key);
+        if (it == end()) {
+#if JSON_EXCEPTIONS
+            throw std::out_of_range("flat_map::at");
+#else
+            std::abort();
+#endif
+        }
+        return it->second;
+    }
+
+    const Value &at(const Key &key) const {
+        return const_cast<flat_map *>(this)->at(key);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args) {
+        iterator it = lower_bound(key);
+        if (it != end() && !m_compare(key, it->first)) {
+            return {it, false};
+        }
+        it = m_items.emplace(it, std::piecewise_construct,
+            std::forward_as_tuple(key),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        return {it, true};
+    }
+
+    std::pair<iterator, bool> insert(const value_type &item) {
+        return try_emplace(item.first, item.second);
+    }
+
+    Value &operator[](const Key &key) {
+        return try_emplace(key).first->second;
+    }
+
+    size_t erase(const Key &key) {
+        iterator it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        m_items.erase(it);
+        return 1;
+    }
+
+    // takes the sorted items, leaving the map empty
+    container_type extract() && {
+        return std::move(m_items);
+    }
+
+    // adopts items that are sorted and unique by key
+    void replace(container_type &&items) {
+        m_items = std::move(items);
+    }
+
+    bool operator==(const flat_map &other) const {
+        return m_items == other.m_items;
+    }
+};
+
+template <typename Key, typename Compare = std::less<Key>>
+class flat_set
+{
+public:
+    using key_type = Key;
+    using value_type = Key;
+    using key_compare = Compare;
+    using container_type = std::vector<Key>;
+    using iterator = typename container_type::const_iterator;
+    using const_iterator = typename container_type::const_iterator;
+
+private:
+    container_type m_items;
+    Compare m_compare;
+
+    static const Key &keyOf(const Key &item) {
+        return item;
+    }
+
+public:
+    flat_set() = default;
+
+    flat_set(std::initializer_list<Key> items) : m_items(items) {
+        sortUnique(m_items, keyOf, m_compare);
+    }
+
+    const_iterator begin() const {
+        return m_items.begin();
+    }
+
+    const_iterator end() const {
+        return m_items.end();
+    }
+
+    size_t size() const {
+        return m_items.size();
+    }
+
+    bool empty() const {
+        return m_items.empty();
+    }
+
+    void clear() {
+        m_items.clear();
+    }
+
+    void reserve(size_t size) {
+        m_items.reserve(size);
+    }
+
+    key_compare key_comp() const {
+        return m_compare;
+    }
+
+    const_iterator lower_bound(const Key &key) const {
+        return std::lower_bound(m_items.begin(), m_items.end(), key, m_compare);
+    }
+
+    const_iterator find(const Key &key) const {
+        const_iterator it = lower_bound(key);
+        return it != end() && !m_compare(key, *it) ? it : end();
+    }
+
+    size_t count(const Key &key) const {
+        return find(key) != end();
+    }
+
+    bool contains(const Key &key) const {
+        return find(key) != end();
+    }
+
+    std::pair<iterator, bool> insert(Key key) {
+        const_iterator it = lower_bound(key);
+        if (it != end() && !m_compare(key, *it)) {
+            return {it, false};
+        }
+        return {m_items.insert(it, std::move(key)), true};
+    }
+
+    size_t erase(const Key &key) {
+        const_iterator it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        m_items.erase(it);
+        return 1;
+    }
+
+    // takes the sorted items, leaving the set empty
+    container_type extract() && {
+        return std::move(m_items);
+    }
+
+    // adopts items that are sorted and unique
+    void replace(container_type &&items) {
+        m_items = std::move(items);
+    }
+
+    bool operator==(const flat_set &other) const {
+        return m_items == other.m_items;
+    }
+};
+
+template <typename T>
+constexpr bool isFlatMap() {
+#ifdef __cpp_lib_flat_map
+    if constexpr (is_specialization<T, std::flat_map>().value) {
+        return true;
+    }
+#endif
+    return is_specialization<T, flat_map>().value;
+}
+
+template <typename T>
+constexpr bool isFlatSet() {
+#ifdef __cpp_lib_flat_set
+    if constexpr (is_specialization<T, std::flat_set>().value) {
+        return true;
+    }
+#endif
+    return is_specialization<T, flat_set>().value;
+}
+// }}}
+// SERIALIZE {{{
+// the dynamic document types, defined in DOCUMENT
+class document;
+class value;
+
+template <typename T>
+std::string serialize(const T &item);
+
+template <typename T>
+std::string serialize(const T &item, const Options &options);
+
+template <typename T>
+void serialize(const T &item, Writer &writer);
+
+template <typename T>
+void serializeUniquePointer(const std::unique_ptr<T> &item, Writer &writer) {
+    if (item) {
+        serialize(*item, writer);
+    }
+    else {
+        writer.write("null");
+    }
+}
+
+template <typename T>
+void serializeOptional(const std::optional<T> &item, Writer &writer) {
     if (item) {
-        return serialize(*item);
+        serialize(*item, writer);
     }
     else {
-        return "null";
+        writer.write("null");
     }
 }
 
 template <typename T, typename Y>
-std::string serializePair(const std::pair<T, Y> &item) {
-    JsonArrayBuilder array;
-    array.add(serialize(item.first));
-    array.add(serialize(item.second));
-    return array.build();
+void serializePair(const std::pair<T, Y> &item, Writer &writer) {
+    JsonArrayWriter array(writer);
+    array.start();
+    array.next();
+    serialize(item.first, writer);
+    array.next();
+    serialize(item.second, writer);
+    array.finish();
 }
 
 template <typename ...T>
-std::string serializeTuple(const std::tuple<T...> &item) {
-    JsonArrayBuilder array;
+void serializeTuple(const std::tuple<T...> &item, Writer &writer) {
+    JsonArrayWriter array(writer);
+    array.start();
     constexpr auto size = std::tuple_size<std::tuple<T...>>::value;
     for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
-        array.add(serialize(std::get<i>(item)));
+        array.next();
+        serialize(std::get<i>(item), writer);
     });
-    return array.build();
+    array.finish();
 }
 
-inline std::string serializeBoolVector(const std::vector<bool> &item) {
-    JsonArrayBuilder array;
+inline void serializeBoolVector(const std::vector<bool> &item, Writer &writer) {
+    JsonArrayWriter array(writer);
+    array.start();
     for (const auto &elem : item) {
-        array.add(elem ? "true" : "false");
+        array.next();
+        writer.write(elem ? "true" : "false");
     }
-    return array.build();
+    array.finish();
 }
 
 template <typename T>
-std::string serializeVector(const T &item) {
-    JsonArrayBuilder array;
+void serializeVector(const T &item, Writer &writer) {
+    JsonArrayWriter array(writer);
+    array.start();
     for (const auto &elem : item) {
-        array.add(serialize(elem));
+        array.next();
+        serialize(elem, writer);
     }
-    return array.build();
+    array.finish();
 }
 
 template <typename T>
-std::string serializeQueue(const std::queue<T> &item) {
-    JsonArrayBuilder array;
+void serializeQueue(const std::queue<T> &item, Writer &writer) {
+    JsonArrayWriter array(writer);
+    array.start();
     std::queue<T> copy = item;
     while (copy.size()) {
-        array.add(serialize(copy.front()));
+        array.next();
+        serialize(copy.front(), writer);
         copy.pop();
     }
-    return array.build();
+    array.finish();
 }
 
+// the shortest text that parses back to `item`, with one spelling of zero
+// and null for values json cannot represent. needs 64 bytes at `out`.
 template <typename T>
-std::string serializeSet(const T &item) {
-    std::deque<int> x;
-    JsonArrayBuilder array;
-    for (const auto &elem : item) {
-        array.add(serialize(elem));
+char *writeCanonicalNumber(const T &item, char *out) {
+    if constexpr (std::is_floating_point<T>().value) {
+        if (!std::isfinite(item)) {
+            memcpy(out, "null", 4);
+            return out + 4;
+        }
+        if (item == 0) {
+            *out = '0';
+            return out + 1;
+        }
+    }
+    return std::to_chars(out, out + 64, item).ptr;
+}
+
+// whether iterating `T` already visits its elements in the order of
+// std::less, the canonical order of set elements
+template <typename T>
+constexpr bool isOrderedByLess() {
+    if constexpr (requires { typename T::key_compare; }) {
+        return std::is_same<typename T::key_compare,
+            std::less<typename T::key_type>>().value;
+    }
+    return false;
+}
+
+// calls `f` on the elements of `range` in the order of `less`. sorts small
+// handles made by `handle` rather than the elements, on the stack for up
+// to 32 of them.
+template <typename Handle, typename Range, typename MakeHandle, typename Less, typename F>
+void forEachSorted(
+    const Range &range, size_t size, MakeHandle handle, Less less, F &&f
+) {
+    Handle stack[32];
+    std::vector<Handle> heap;
+    Handle *begin = stack;
+    if (size > 32) {
+        heap.resize(size);
+        begin = heap.data();
+    }
+    Handle *end = begin;
+    for (const auto &element : range) {
+        *end++ = handle(element);
+    }
+    std::sort(begin, end, less);
+    for (Handle *it = begin; it != end; it++) {
+        f(*it);
+    }
+}
+
+// orders map keys by the text they serialize to
+template <typename Key>
+bool keyTextLess(const Key &lhs, const Key &rhs, const Options &options) {
+    if constexpr (std::is_same<Key, std::string>().value) {
+        return lhs < rhs;
+    }
+    else if constexpr (std::is_same<Key, char *>().value
+            || std::is_same<Key, const char *>().value) {
+        return strcmp(lhs, rhs) < 0;
+    }
+    else if constexpr (std::is_enum<Key>().value) {
+        using Type = typename std::underlying_type<Key>::type;
+        return keyTextLess((Type)lhs, (Type)rhs, options);
+    }
+    else if constexpr (std::is_same<Key, bool>().value) {
+        // "false" before "true"
+        return lhs < rhs;
+    }
+    else if constexpr (std::is_same<Key, char>().value) {
+        return keyTextLess((unsigned char)lhs, (unsigned char)rhs, options);
     }
-    return array.build();
+    else if constexpr (std::is_arithmetic<Key>().value) {
+        char lhsText[64];
+        char rhsText[64];
+        std::string_view lhsView(lhsText, writeCanonicalNumber(lhs, lhsText) - lhsText);
+        std::string_view rhsView(rhsText, writeCanonicalNumber(rhs, rhsText) - rhsText);
+        return lhsView < rhsView;
+    }
+    else {
+        return serialize(lhs, options) < serialize(rhs, options);
+    }
+}
+
+template <typename T>
+void serializeSet(const T &item, Writer &writer) {
+    using Element = typename T::value_type;
+    JsonArrayWriter array(writer);
+    array.start();
+    auto element = [&](const Element &elem) {
+        array.next();
+        serialize(elem, writer);
+    };
+    if (!isOrderedByLess<T>() && writer.options.canonical) {
+        forEachSorted<const Element *>(item, item.size(),
+            [](const Element &elem) { return &elem; },
+            [&](const Element *lhs, const Element *rhs) {
+                if constexpr (requires { *lhs < *rhs; }) {
+                    return *lhs < *rhs;
+                }
+                else {
+                    return serialize(*lhs, writer.options)
+                        < serialize(*rhs, writer.options);
+                }
+            },
+            [&](const Element *elem) { element(*elem); });
+    }
+    else {
+        for (const auto &elem : item) {
+            element(elem);
+        }
+    }
+    array.finish();
 }
 
 template <typename T>
-std::string serializeMap(const T &item) {
+void serializeMap(const T &item, Writer &writer) {
     using KeyType = typename std::decay<decltype(item.begin()->first)>::type;
-    JsonObjectBuilder jsonObject;
-    for (const auto &it : item) {
+    using Entry = typename std::decay<decltype(*item.begin())>::type;
+    JsonObjectWriter object(writer);
+    object.start();
+    auto entry = [&](const Entry &it) {
+        object.next();
         constexpr bool isString = std::is_same<KeyType, std::string>().value ||
             std::is_same<KeyType, char *>().value ||
             std::is_same<KeyType, const char *>().value;
         if constexpr (isString) {
-            jsonObject.key(serialize(it.first));
+            serialize(it.first, writer);
+        }
+        else if constexpr (std::is_arithmetic<KeyType>().value
+                || std::is_enum<KeyType>().value) {
+            // numbers never need escaping
+            writer.put('"');
+            serialize(it.first, writer);
+            writer.put('"');
         }
         else {
-            jsonObject.key(serialize(serialize(it.first)));
+            serialize(serialize(it.first, writer.options), writer);
+        }
+        object.value();
+        serialize(it.second, writer);
+    };
+    // only string keys in std::less order are in the order of their text
+    constexpr bool sorted = isOrderedByLess<T>()
+        && std::is_same<KeyType, std::string>().value;
+    if (!sorted && writer.options.canonical) {
+        forEachSorted<const Entry *>(item, item.size(),
+            [](const Entry &it) { return &it; },
+            [&](const Entry *lhs, const Entry *rhs) {
+                return keyTextLess(lhs->first, rhs->first, writer.options);
+            },
+            [&](const Entry *it) { entry(*it); });
+    }
+    else {
+        for (const auto &it : item) {
+            entry(it);
         }
-        jsonObject.value(serialize(it.second));
     }
-    return jsonObject.build();
+    object.finish();
 }
 
 template <typename T>
-std::string serializeString(const T &item) {
+void serializeString(const T &item, Writer &writer) {
+    JSON_INSTRUMENT_COUNT(strings);
     const char *str;
     size_t len;
     if constexpr (std::is_same<T, std::string>().value) {
         str = item.c_str();
         len = item.size();
     }
+    else if constexpr (std::is_same<T, std::string_view>().value) {
+        str = item.data();
+        len = item.size();
+    }
     else {
         str = item;
         len = strlen(item);
     }
-    std::string string;
-    string += '"';
-    for (int i = 0; i < len; i++) {
-        switch ((unsigned char)str[i]) {
+    int flags = simd::STOP_CONTROL;
+    if (writer.options.encodeAscii) {
+        flags |= simd::STOP_NON_ASCII;
+    }
+    if (writer.options.validateUtf8) {
+        flags |= simd::VALIDATE_UTF8;
+    }
+    const char *p = str;
+    const char *end = str + len;
+    writer.put('"');
+    while (true) {
+        const char *invalid = nullptr;
+        const char *stop = simd::scanString(p, end, flags, &invalid);
+        if (invalid) {
+            throwError({"invalid utf-8 codepoint", (int64_t)(invalid - str)});
+        }
+        writer.write(p, stop - p);
+        if (stop == end) {
+            break;
+        }
+        p = stop;
+        switch ((unsigned char)*p) {
             case 128 ... 255: {
-#ifndef JSON_ENCODE_ASCII
-                string += str[i];
-#else
-                try {
-                    string += utf8::escapeCodepoint(str, &i);
+                // escape the whole run of non-ascii characters at once. no
+                // sequence expands to more than three times its length.
+                const char *runEnd = simd::skipNonAscii(p, end);
+                if (runEnd - p > 4096) {
+                    runEnd = p + 4096;
                 }
-                catch (const std::exception&) {
-                    throw exception("invalid utf-8 codepoint", 0);
+                char *out = writer.reserve(3 * (runEnd - p) + 12);
+                while (p < runEnd) {
+                    int cp = 0;
+                    int length = utf8::decode(p, end, &cp);
+                    if (!length) {
+                        writer.advance(out);
+                        throwError({"invalid utf-8 codepoint", (int64_t)(p - str)});
+                    }
+                    out = utf8::escapeCodepoint(out, cp);
+                    p += length;
                 }
-#endif
-                break;
+                writer.advance(out);
+                continue;
             }
-            case 0 ... 7:
-            case 11 ... 12:
-            case 14 ... 31:
-            case 127:
-                char buf[7];
-                snprintf(buf, sizeof(buf), "\\u%.4x", (unsigned char)str[i]);
-                string += std::string(buf, 6);
-                break;
             case '\n':
-                string += "\\n";
+                writer.write("\\n");
                 break;
             case '\b':
-                string += "\\b";
+                writer.write("\\b");
                 break;
             case '\r':
-                string += "\\r";
+                writer.write("\\r");
                 break;
             case '\t':
-                string += "\\t";
+                writer.write("\\t");
                 break;
             case '"':
-                string += "\\\"";
+                writer.write("\\\"");
                 break;
             case '\\':
-                string += "\\\\";
+                writer.write("\\\\");
                 break;
             default:
-                string += *(str + i);
+                writer.advance(utf8::writeEscape(writer.reserve(6), *p));
                 break;
         }
+        p++;
     }
-    return string + '"';
+    writer.put('"');
 }
 
-inline std::string serializeBool(const bool &item) {
-    return item ? "true" : "false";
+inline void serializeBool(const bool &item, Writer &writer) {
+    writer.write(item ? "true" : "false");
 }
 
 template <typename T, size_t N>
-std::string serializeArray(const T(&item)[N]) {
-    JsonArrayBuilder array;
+void serializeArray(const T(&item)[N], Writer &writer) {
+    JsonArrayWriter array(writer);
+    array.start();
     for (int i = 0; i < N; i++) {
-        array.add(serialize(item[i]));
+        array.next();
+        serialize(item[i], writer);
     }
-    return array.build();
+    array.finish();
 }
 
 template <typename T>
-std::string serializePointer(const T &item) {
+void serializePointer(const T &item, Writer &writer) {
     if (item == nullptr) {
-        return "null";
+        writer.write("null");
     }
     else {
-        return serialize(*item);
+        serialize(*item, writer);
     }
 }
 
 template <typename T>
-std::string serializeEnum(const T &item) {
-    return std::to_string(item);
+void serializeNumber(const T &item, Writer &writer) {
+    JSON_INSTRUMENT_COUNT(numbers);
+    if constexpr (std::is_floating_point<T>().value) {
+        if (writer.options.canonical) {
+            writer.advance(writeCanonicalNumber(item, writer.reserve(64)));
+            return;
+        }
+    }
+    if constexpr (std::is_same<T, long double>().value) {
+        writer.write(std::to_string(item));
+    }
+    else if constexpr (std::is_floating_point<T>().value) {
+        // the "%f" format of std::to_string, without the allocation
+        constexpr size_t maxLength = 16 + std::numeric_limits<T>::max_exponent10;
+        char *out = writer.reserve(maxLength);
+        out = std::to_chars(
+            out, out + maxLength, item, std::chars_format::fixed, 6).ptr;
+        writer.advance(out);
+    }
+    else {
+        constexpr size_t maxLength = 24;
+        char *out = writer.reserve(maxLength);
+        writer.advance(std::to_chars(out, out + maxLength, item).ptr);
+    }
 }
 
 template <typename T>
-std::string serializeNumber(const T &item) {
-    return std::to_string(item);
+void serializeEnum(const T &item, Writer &writer) {
+    serializeNumber((typename std::underlying_type<T>::type)item, writer);
+}
+
+inline void serializeBytes(const uint8_t *data, size_t size, Writer &writer) {
+    JSON_INSTRUMENT_COUNT(strings);
+    char *out = writer.reserve(base64::encodedSize(size) + 2);
+    *out++ = '"';
+    out = base64::encode(data, size, out);
+    *out++ = '"';
+    writer.advance(out);
 }
 
-inline std::string serializeChar(const char &item) {
+inline void serializeChar(const char &item, Writer &writer) {
     unsigned char value = item;
-    return std::to_string(value);
+    serializeNumber(value, writer);
 }
 
+// the field indices of T in the order of their keys, for canonical output
 template <typename T>
-std::string serializeClass(const T& item) {
-    JsonObjectBuilder jsonObject;
+constexpr auto sortedFields() {
     constexpr auto props = properties<T>();
     constexpr auto size = std::tuple_size<decltype(props)>::value;
+    std::array<std::string_view, size> keys{};
     for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
-        constexpr auto property = std::get<i>(properties<T>());
-        jsonObject.quotedKey(property.key);
-        jsonObject.value(serialize(item.*(property.value)));
+        keys[i] = std::get<i>(props).key;
+    });
+    std::array<size_t, size> order{};
+    for (size_t i = 0; i < size; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return keys[lhs] < keys[rhs];
     });
-    return jsonObject.build();
+    return order;
 }
 
 template <typename T>
-std::string serialize(const T &item) {
+void serializeClass(const T& item, Writer &writer) {
+    JsonObjectWriter object(writer);
+    object.start();
+    constexpr auto props = properties<T>();
+    constexpr auto size = std::tuple_size<decltype(props)>::value;
+    // each field of a masked class sets the mask of its own value, and the
+    // mask is restored for the next element of a container of T
+    const int32_t *mask = writer.mask;
+    auto field = [&](auto i) {
+        constexpr auto property = std::get<i>(properties<T>());
+        constexpr std::string_view key = property.key;
+        if (omitField<T, i>(item)) {
+            return;
+        }
+        if (mask) {
+            if (mask[i] < 0) {
+                return;
+            }
+            writer.mask = mask[i] ? mask + i + mask[i] : nullptr;
+        }
+        object.quotedKey(key);
+        serialize(item.*(property.value), writer);
+    };
+    if (writer.options.canonical) {
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            field(std::integral_constant<size_t, sortedFields<T>()[i]>{});
+        });
+    }
+    else {
+        for_sequence(std::make_index_sequence<size>{}, field);
+    }
+    writer.mask = mask;
+    object.finish();
+}
+
+// `Custom` allows falling back to a user specialization of
+// `std::string serialize(const T &)` for classes that are not reflected.
+// it is false when called from that function itself.
+template <bool Custom, typename T>
+void serializeValue(const T &item, Writer &writer) {
     if constexpr (is_specialization<T, std::unique_ptr>().value) {
-        return serializeUniquePointer(item);
+        serializeUniquePointer(item, writer);
     }
     else if constexpr (is_specialization<T, std::optional>().value) {
-        return serializeOptional(item);
+        serializeOptional(item, writer);
     }
     else if constexpr (is_specialization<T, std::pair>().value) {
-        return serializePair(item);
+        serializePair(item, writer);
     }
     else if constexpr (is_specialization<T, std::tuple>().value) {
-        return serializeTuple(item);
+        serializeTuple(item, writer);
     }
     else if constexpr (std::is_same<T, std::vector<bool>>().value) {
-        return serializeBoolVector(item);
+        serializeBoolVector(item, writer);
     }
     else if constexpr (is_specialization<T, std::vector>().value) {
-        return serializeVector(item);
+        serializeVector(item, writer);
     }
     else if constexpr (is_specialization<T, std::list>().value) {
-        return serializeVector(item);
+        serializeVector(item, writer);
     }
     else if constexpr (is_specialization<T, std::deque>().value) {
-        return serializeVector(item);
+        serializeVector(item, writer);
     }
     else if constexpr (is_specialization<T, std::queue>().value) {
-        return serializeQueue(item);
+        serializeQueue(item, writer);
     }
     else if constexpr (is_specialization<T, std::set>().value) {
-        return serializeSet(item);
+        serializeSet(item, writer);
     }
     else if constexpr (is_specialization<T, std::unordered_set>().value) {
-        return serializeSet(item);
+        serializeSet(item, writer);
     }
     else if constexpr (is_specialization<T, std::map>().value) {
-        return serializeMap(item);
+        serializeMap(item, writer);
     }
     else if constexpr (is_specialization<T, std::unordered_map>().value) {
-        return serializeMap(item);
+        serializeMap(item, writer);
+    }
+    else if constexpr (isFlatMap<T>()) {
+        serializeMap(item, writer);
+    }
+    else if constexpr (isFlatSet<T>()) {
+        serializeSet(item, writer);
     }
     else if constexpr (std::is_same<T, std::string>().value) {
-        return serializeString(item);
+        serializeString(item, writer);
     }
     else if constexpr (std::is_same<T, char *>().value) {
-        return serializeString(item);
+        serializeString(item, writer);
     }
     else if constexpr (std::is_same<T, const char *>().value) {
-        return serializeString(item);
+        serializeString(item, writer);
     }
     else if constexpr (std::is_array<T>().value) {
-        return serializeArray(item);
+        serializeArray(item, writer);
     }
     else if constexpr (std::is_same<T, bool>().value) {
-        return serializeBool(item);
+        serializeBool(item, writer);
     }
     else if constexpr (std::is_pointer<T>().value) {
-        return serializePointer(item);
+        serializePointer(item, writer);
     }
     else if constexpr (std::is_enum<T>().value) {
-        return serializeEnum(item);
+        serializeEnum(item, writer);
     }
     else if constexpr (std::is_same<T, char>().value) {
-        return serializeChar(item);
+        serializeChar(item, writer);
     }
     else if constexpr (std::is_arithmetic<T>().value) {
-        return serializeNumber(item);
+        serializeNumber(item, writer);
+    }
+    else if constexpr (std::is_same<T, document>().value
+            || std::is_same<T, value>().value) {
+        serializeDocument(item, writer);
+    }
+    else if constexpr (std::is_same<T, bytes>().value
+            || std::is_same<T, std::span<const uint8_t>>().value) {
+        serializeBytes(item.data(), item.size(), writer);
+    }
+    else if constexpr (std::is_same<T, std::span<const std::byte>>().value) {
+        serializeBytes((const uint8_t *)item.data(), item.size(), writer);
     }
     else if constexpr (std::is_class<T>().value) {
-        return serializeClass(item);
+        if constexpr (isReflected<T>()) {
+            JSON_INSTRUMENT_BEGIN(SERIALIZE, T, false, writer.written());
+            serializeClass(item, writer);
+            JSON_INSTRUMENT_END(writer.written());
+        }
+        else if constexpr (Custom) {
+            writer.write(serialize(item));
+        }
+        else {
+            static_assert(!sizeof(T), "type is not REFLECTed");
+        }
     }
 }
-// }}}
-// DESERIALIZE {{{
-template <typename T>
-void deserialize(T &item, Cursor &cursor);
+
+// user specializations of `std::string serialize(const T &)` apply to
+// nested values too. they cannot be detected at compile time, so the first
+// value of each type calls that function with the probe set. the primary
+// template writes the item into the probing writer and clears the probe,
+// while a specialization leaves it set.
+struct SerializeProbe {
+    const void *item = nullptr;
+    const void *type = nullptr;
+    Writer *writer = nullptr;
+};
+
+inline thread_local SerializeProbe serializeProbe;
 
 template <typename T>
-void deserialize(T &item, const std::string &json);
+inline constexpr char serializeProbeTag = 0;
 
 template <typename T>
-T deserialize(const std::string &json);
+void serialize(const T &item, Writer &writer) {
+    // -1 until probed, then whether the function is specialized
+    static std::atomic<int8_t> specialized{-1};
+    int8_t state = specialized.load(std::memory_order_relaxed);
+    if (state == 0) {
+        serializeValue<true>(item, writer);
+        return;
+    }
+    if (state == 1) {
+        writer.write(serialize(item));
+        return;
+    }
+    serializeProbe = {&item, &serializeProbeTag<T>, &writer};
+    std::string custom = serialize(item);
+    bool isSpecialized = serializeProbe.writer != nullptr;
+    serializeProbe = {};
+    specialized.store(isSpecialized, std::memory_order_relaxed);
+    if (isSpecialized) {
+        writer.write(custom);
+    }
+}
 
 template <typename T>
-void deserializeUniquePointer(std::unique_ptr<T> &item, Cursor &cursor) {
-    item = std::make_unique<T>();
-    deserialize(*item, cursor);
+std::string serialize(const T &item, const Options &options) {
+    Writer writer(options);
+    JSON_INSTRUMENT_BEGIN(SERIALIZE, T, true, 0);
+    serialize(item, writer);
+    JSON_INSTRUMENT_END(writer.written());
+    return writer.take();
 }
 
 template <typename T>
-void deserializeOptional(std::optional<T> &item, Cursor &cursor) {
-    std::string keyword = cursor.peekKeyword();
-    if (keyword == "null") {
-        cursor.next(keyword.size());
-        item.reset();
-    }
-    else {
-        T tmp;
-        deserialize(tmp, cursor);
-        item = tmp;
+std::string serialize(const T &item) {
+    if (serializeProbe.item == &item
+            && serializeProbe.type == &serializeProbeTag<T>) {
+        Writer &probing = *serializeProbe.writer;
+        serializeProbe = {};
+        serializeValue<false>(item, probing);
+        return {};
     }
+    Writer writer;
+    JSON_INSTRUMENT_BEGIN(SERIALIZE, T, true, 0);
+    serializeValue<false>(item, writer);
+    JSON_INSTRUMENT_END(writer.written());
+    return writer.take();
 }
-
-template <typename T, typename Y>
-void deserializePair(std::pair<T, Y> &item, Cursor &cursor) {
+// }}}
+// FIELD MASKS {{{
+// the type whose fields a path continues into: the class inside optionals,
+// pointers, containers and map values
+template <typename T>
+constexpr auto maskTarget() {
+    if constexpr (is_specialization<T, std::optional>().value
+            || is_specialization<T, std::unique_ptr>().value) {
+        return maskTarget<typename std::decay<decltype(*std::declval<T>())>::type>();
+    }
+    else if constexpr (std::is_pointer<T>().value
+            && !std::is_same<T, char *>().value
+            && !std::is_same<T, const char *>().value) {
+        return maskTarget<typename std::remove_pointer<T>::type>();
+    }
+    else if constexpr (std::is_array<T>().value) {
+        return maskTarget<typename std::remove_extent<T>::type>();
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value
+            || isFlatMap<T>()) {
+        return maskTarget<typename T::mapped_type>();
+    }
+    else if constexpr ((is_specialization<T, std::vector>().value
+                && !std::is_same<T, std::vector<bool>>().value)
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value
+            || isFlatSet<T>()) {
+        return maskTarget<typename T::value_type>();
+    }
+    else {
+        return std::type_identity<T>();
+    }
+}
+
+// a runtime selection of the fields of T to serialize, compiled once from
+// paths like "id,owner.name,items.price" and reusable for any number of
+// calls. a path names a field, and may continue into the fields of a
+// nested class, also through optionals, pointers, containers and map
+// values. a default constructed mask selects everything.
+template <typename T>
+class field_mask
+{
+    static_assert(isReflected<T>(), "field_mask needs a REFLECTed class");
+
+    // one run of entries per masked class, one entry per field: -1 leaves
+    // the field out, 0 writes all of it, and otherwise the distance from
+    // the entry to the run of the nested class
+    std::vector<int32_t> m_entries;
+
+    template <typename U>
+    static size_t addRun(std::vector<int32_t> &entries) {
+        size_t run = entries.size();
+        entries.resize(run + std::tuple_size<decltype(properties<U>())>::value, -1);
+        return run;
+    }
+
+    // adds the path at `pos` to the run of U, up to the next ','
+    template <typename U>
+    static void addPath(
+        std::vector<int32_t> &entries, size_t run, std::string_view paths,
+        size_t &pos, error &err
+    ) {
+        size_t start = pos;
+        while (pos < paths.size() && paths[pos] != '.' && paths[pos] != ',') {
+            pos++;
+        }
+        std::string_view name = paths.substr(start, pos - start);
+        if (name.empty()) {
+            err = {"expected field name", (int64_t)start};
+            return;
+        }
+        bool found = false;
+        constexpr auto size = std::tuple_size<decltype(properties<U>())>::value;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            constexpr auto property = std::get<i>(properties<U>());
+            if (found || property.key != name) {
+                return;
+            }
+            found = true;
+            if (pos == paths.size() || paths[pos] == ',') {
+                // the whole field, even if some of it was selected before
+                entries[run + i] = 0;
+                return;
+            }
+            using Field = typename std::decay<decltype(std::declval<U>().*(property.value))>::type;
+            using Target = typename decltype(maskTarget<Field>())::type;
+            if constexpr (isReflected<Target>()) {
+                pos++;
+                int32_t entry = entries[run + i];
+                // a field selected whole still has the rest of the path
+                // checked, against a run nothing points to
+                size_t nested = entry > 0 ? run + i + entry : addRun<Target>(entries);
+                if (entry < 0) {
+                    entries[run + i] = (int32_t)(nested - run - i);
+                }
+                addPath<Target>(entries, nested, paths, pos, err);
+            }
+            else {
+                err = {"field '" + std::string(name) + "' has no fields", (int64_t)pos};
+            }
+        });
+        if (!found) {
+            err = {"unknown field '" + std::string(name) + "'", (int64_t)start};
+        }
+    }
+
+public:
+    field_mask() = default;
+
+    static result<field_mask> try_compile(std::string_view paths) {
+        result<field_mask> res;
+        std::vector<int32_t> &entries = res.value.m_entries;
+        addRun<T>(entries);
+        size_t pos = 0;
+        while (!paths.empty() && !res.error) {
+            addPath<T>(entries, 0, paths, pos, res.error);
+            if (pos == paths.size()) {
+                break;
+            }
+            pos++;
+        }
+        if (res.error) {
+            entries.clear();
+        }
+        return res;
+    }
+
+    static field_mask compile(std::string_view paths) {
+        result<field_mask> res = try_compile(paths);
+        if (res.error) {
+            throwError(res.error);
+        }
+        return std::move(res.value);
+    }
+
+    // the entries of T, or null to select everything
+    const int32_t *data() const {
+        return m_entries.empty() ? nullptr : m_entries.data();
+    }
+};
+
+// `item` is a T, or a container of them
+template <typename T, typename U>
+void serialize(const T &item, const field_mask<U> &mask, Writer &writer) {
+    static_assert(std::is_same<typename decltype(maskTarget<T>())::type, U>().value,
+        "the field_mask is for another type");
+    const int32_t *outer = writer.mask;
+    writer.mask = mask.data();
+    serialize(item, writer);
+    writer.mask = outer;
+}
+
+template <typename T, typename U>
+std::string serialize(
+    const T &item, const field_mask<U> &mask, const Options &options = Options()
+) {
+    Writer writer(options);
+    JSON_INSTRUMENT_BEGIN(SERIALIZE, T, true, 0);
+    serialize(item, mask, writer);
+    JSON_INSTRUMENT_END(writer.written());
+    return writer.take();
+}
+// }}}
+// DESERIALIZE {{{
+template <typename T>
+void deserialize(T &item, Cursor &cursor);
+
+template <typename T>
+void deserialize(
+    T &item, std::string_view json, const Options &options = Options());
+
+template <typename T>
+T deserialize(std::string_view json, const Options &options = Options());
+
+template <typename T>
+void deserializeUniquePointer(std::unique_ptr<T> &item, Cursor &cursor) {
+    if (cursor.peekKeyword() == "null") {
+        cursor.next(4);
+        item.reset();
+        return;
+    }
+    item = std::make_unique<T>();
+    deserialize(*item, cursor);
+}
+
+template <typename T>
+void deserializeOptional(std::optional<T> &item, Cursor &cursor) {
+    std::string keyword = cursor.peekKeyword();
+    if (keyword == "null") {
+        cursor.next(keyword.size());
+        item.reset();
+    }
+    else {
+        T tmp{};
+        deserialize(tmp, cursor);
+        item = std::move(tmp);
+    }
+}
+
+template <typename T, typename Y>
+void deserializePair(std::pair<T, Y> &item, Cursor &cursor) {
     item = std::pair<T, Y>();
     JsonArrayParser arrayParser(cursor);
     arrayParser.start();
@@ -801,80 +3194,378 @@ void deserializeTuple(std::tuple<T...> &item, Cursor &cursor) {
     arrayParser.finish();
 }
 
-inline void deserializeBoolVector(std::vector<bool> &item, Cursor &cursor) {
-    item = std::vector<bool>();
+// parses the number at `p` in the json grammar, leaving `p` after it
+template <typename T>
+bool parseNumber(const char *&p, const char *end, T &item) {
+    const char *digits = p < end && *p == '-' ? p + 1 : p;
+    if (digits == end || !isdigit((unsigned char)*digits)) {
+        return false;
+    }
+    if constexpr (std::is_same<T, char>().value) {
+        unsigned char value = 0;
+        bool ok = parseNumber(p, end, value);
+        item = value;
+        return ok;
+    }
+    else {
+        auto [ptr, ec] = std::from_chars(p, end, item);
+        p = ptr;
+        return ec == std::errc();
+    }
+}
+
+// parses up to `limit` comma separated numbers of an array in one tight
+// loop, only falling back to the cursor for whitespace and comments
+template <typename T, typename F>
+void deserializeNumbers(Cursor &cursor, size_t limit, F &&emit) {
     JsonArrayParser arrayParser(cursor);
     arrayParser.start();
-    while (arrayParser.optionalNext()) {
-        bool result;
-        deserialize(result, cursor);
-        item.push_back(result);
+    cursor.skipWhitespaceAndComments();
+    if (cursor.peek() == ']' || !limit) {
+        arrayParser.finish();
+        return;
+    }
+    const char *data = cursor.string.data();
+    const char *end = data + cursor.string.size();
+    const char *p = cursor.c_str();
+    for (size_t count = 1; ; count++) {
+        T value;
+        if (!parseNumber(p, end, value)) {
+            cursor.idx = p - data;
+            cursor.fail("invalid number");
+            return;
+        }
+        JSON_INSTRUMENT_COUNT(numbers);
+        emit(value);
+        if (count == limit) {
+            cursor.idx = p - data;
+            break;
+        }
+        if (end - p >= 2 && p[0] == ',' && (isdigit((unsigned char)p[1]) || p[1] == '-')) {
+            p++;
+            continue;
+        }
+        cursor.idx = p - data;
+        cursor.skipWhitespaceAndComments();
+        if (cursor.peek() != ',') {
+            break;
+        }
+        cursor.next();
+        cursor.skipWhitespaceAndComments();
+        p = cursor.c_str();
     }
     arrayParser.finish();
 }
 
 template <typename T>
-void deserializeVector(T &item, Cursor &cursor) {
-    using Type = typename std::decay<decltype(*item.begin())>::type;
-    item = T();
+void deserializeNumberVector(std::vector<T> &item, Cursor &cursor) {
+    item.clear();
+    item.reserve(simd::countArrayElements(
+        cursor.c_str(), cursor.string.data() + cursor.string.size()));
+    deserializeNumbers<T>(cursor, SIZE_MAX, [&](T value) {
+        item.push_back(value);
+    });
+}
+
+inline void deserializeBoolVector(std::vector<bool> &item, Cursor &cursor) {
+    item.clear();
+    item.reserve(simd::countArrayElements(
+        cursor.c_str(), cursor.string.data() + cursor.string.size()));
     JsonArrayParser arrayParser(cursor);
     arrayParser.start();
     while (arrayParser.optionalNext()) {
-        item.push_back(Type());
-        deserialize(item.back(), cursor);
+        const char *p = cursor.c_str();
+        size_t remaining = cursor.remaining();
+        if (remaining >= 5 && !memcmp(p, "true", 4) && !isalpha((unsigned char)p[4])) {
+            item.push_back(true);
+            cursor.next(4);
+        }
+        else if (remaining >= 6 && !memcmp(p, "false", 5) && !isalpha((unsigned char)p[5])) {
+            item.push_back(false);
+            cursor.next(5);
+        }
+        else {
+            bool result = false;
+            deserialize(result, cursor);
+            item.push_back(result);
+        }
     }
     arrayParser.finish();
 }
 
+template <typename T>
+void deserializeVector(T &item, Cursor &cursor) {
+    using Type = typename std::decay<decltype(*item.begin())>::type;
+    if constexpr (is_specialization<T, std::vector>().value
+            && std::is_arithmetic<Type>().value) {
+        deserializeNumberVector(item, cursor);
+    }
+    else {
+        item = T();
+        JsonArrayParser arrayParser(cursor);
+        arrayParser.start();
+        while (arrayParser.optionalNext()) {
+            item.push_back(Type());
+            deserialize(item.back(), cursor);
+        }
+        arrayParser.finish();
+    }
+}
+
 template <typename T>
 void deserializeQueue(std::queue<T> &item, Cursor &cursor) {
     item = std::queue<T>();
     JsonArrayParser arrayParser(cursor);
     arrayParser.start();
     while (arrayParser.optionalNext()) {
-        T elem;
+        T elem{};
         deserialize(elem, cursor);
-        item.push(elem);
+        item.push(std::move(elem));
     }
     arrayParser.finish();
 }
 
+// the number of elements or members of the array or object at the cursor
+inline size_t countElements(Cursor &cursor) {
+    cursor.skipWhitespaceAndComments();
+    const char *end = cursor.string.data() + cursor.string.size();
+    if (cursor.c_str() == end) {
+        return 0;
+    }
+    return simd::countElements(cursor.c_str() + 1, end);
+}
+
+// sizes the buckets of an unordered container for the array or object at
+// the cursor, before parsing it
+template <typename T>
+void reserveElements(T &item, Cursor &cursor) {
+    if constexpr (is_specialization<T, std::unordered_map>().value
+            || is_specialization<T, std::unordered_set>().value) {
+        item.reserve(countElements(cursor));
+    }
+}
+
 template <typename T>
 void deserializeSet(T &item, Cursor &cursor) {
     using Type = typename std::decay<decltype(*item.begin())>::type;
-    item = T();
+    item.clear();
+    reserveElements(item, cursor);
     JsonArrayParser arrayParser(cursor);
     arrayParser.start();
     while (arrayParser.optionalNext()) {
-        Type elem;
+        Type elem{};
         deserialize(elem, cursor);
-        item.insert(elem);
+        if constexpr (is_specialization<T, std::set>().value) {
+            // our own output is sorted, so each element goes at the end
+            item.emplace_hint(item.end(), std::move(elem));
+        }
+        else {
+            item.emplace(std::move(elem));
+        }
     }
     arrayParser.finish();
 }
 
+// parses the number between the quotes of a map key
+template <typename T>
+void deserializeNumberKey(T &item, Cursor &cursor) {
+    int64_t keyIdx = cursor.idx;
+    cursor.expect('"');
+    if (cursor.failed()) {
+        return;
+    }
+    const char *begin = cursor.c_str();
+    const char *p = begin;
+    bool ok;
+    if constexpr (std::is_enum<T>().value) {
+        typename std::underlying_type<T>::type value;
+        ok = parseNumber(p, begin + cursor.remaining(), value);
+        item = (T)value;
+    }
+    else {
+        ok = parseNumber(p, begin + cursor.remaining(), item);
+    }
+    cursor.next(p - begin);
+    if (!ok || cursor.peek() != '"') {
+        cursor.fail("invalid key", keyIdx);
+        return;
+    }
+    cursor.next();
+}
+
+// parses a map key, which json always quotes
+template <typename KeyType>
+void deserializeKey(KeyType &key, Cursor &cursor) {
+    constexpr bool isString = std::is_same<KeyType, std::string>().value ||
+        std::is_same<KeyType, char *>().value ||
+        std::is_same<KeyType, const char *>().value;
+    if constexpr (isString) {
+        deserialize(key, cursor);
+    }
+    else if constexpr ((std::is_arithmetic<KeyType>().value
+                && !std::is_same<KeyType, bool>().value)
+            || std::is_enum<KeyType>().value) {
+        deserializeNumberKey(key, cursor);
+    }
+    else {
+        std::string stringKey;
+        int64_t keyIdx = cursor.idx;
+        deserialize(stringKey, cursor);
+        Cursor keyCursor(stringKey, cursor.options);
+        deserialize(key, keyCursor);
+        if (keyCursor.failed() || !keyCursor.eof()) {
+            cursor.fail("invalid key", keyIdx);
+        }
+    }
+}
+
 template <typename T>
 void deserializeMap(T &item, Cursor &cursor) {
     using KeyType = typename std::decay<decltype(item.begin()->first)>::type;
+    item.clear();
+    reserveElements(item, cursor);
     JsonObjectParser objectParser(cursor);
     objectParser.start();
     while (objectParser.optionalNext()) {
         KeyType key;
-        constexpr bool isString = std::is_same<KeyType, std::string>().value ||
-            std::is_same<KeyType, char *>().value ||
-            std::is_same<KeyType, const char *>().value;
-        if constexpr (isString) {
-            deserialize(key, cursor);
+        deserializeKey(key, cursor);
+        objectParser.value();
+        if (cursor.failed()) {
+            return;
+        }
+        // the value is parsed in place. a repeated key parses over the
+        // value before it.
+        if constexpr (is_specialization<T, std::map>().value) {
+            // our own output is sorted, so each key goes at the end
+            deserialize(item.try_emplace(item.end(), std::move(key))->second, cursor);
         }
         else {
-            std::string stringKey;
-            deserialize(stringKey, cursor);
-            deserialize<KeyType>(key, stringKey);
+            deserialize(item.try_emplace(std::move(key)).first->second, cursor);
         }
+    }
+    objectParser.finish();
+}
+
+// appends every member to one vector, then sorts it once unless it arrived
+// sorted
+template <typename T>
+void deserializeFlatMap(T &item, Cursor &cursor) {
+    using KeyType = typename T::key_type;
+    using ValueType = typename T::mapped_type;
+    std::vector<std::pair<KeyType, ValueType>> items;
+    if constexpr (is_specialization<T, flat_map>().value) {
+        // reuses the storage of the last parse
+        items = std::move(item).extract();
+        items.clear();
+    }
+    items.reserve(countElements(cursor));
+    JsonObjectParser objectParser(cursor);
+    objectParser.start();
+    while (objectParser.optionalNext()) {
+        items.emplace_back();
+        deserializeKey(items.back().first, cursor);
         objectParser.value();
-        deserialize(item[key], cursor);
+        if (cursor.failed()) {
+            break;
+        }
+        deserialize(items.back().second, cursor);
     }
     objectParser.finish();
+    sortUnique(items, [](const auto &item) -> const KeyType & {
+        return item.first;
+    }, item.key_comp());
+    if constexpr (is_specialization<T, flat_map>().value) {
+        item.replace(std::move(items));
+    }
+    else {
+        typename T::key_container_type keys;
+        typename T::mapped_container_type values;
+        for (auto &[key, value] : items) {
+            keys.push_back(std::move(key));
+            values.push_back(std::move(value));
+        }
+        item.replace(std::move(keys), std::move(values));
+    }
+}
+
+template <typename T>
+void deserializeFlatSet(T &item, Cursor &cursor) {
+    using KeyType = typename T::key_type;
+    typename T::container_type items = std::move(item).extract();
+    items.clear();
+    items.reserve(countElements(cursor));
+    JsonArrayParser arrayParser(cursor);
+    arrayParser.start();
+    while (arrayParser.optionalNext()) {
+        items.emplace_back();
+        deserialize(items.back(), cursor);
+    }
+    arrayParser.finish();
+    sortUnique(items, [](const KeyType &item) -> const KeyType & {
+        return item;
+    }, item.key_comp());
+    item.replace(std::move(items));
+}
+
+// appends the contents of the string literal at the cursor to `out`
+inline void parseString(Cursor &cursor, std::string &out) {
+    cursor.expect('"');
+    int flags = cursor.options.validateUtf8 ? simd::VALIDATE_UTF8 : 0;
+    const char *end = cursor.string.data() + cursor.string.size();
+    while (!cursor.failed()) {
+        const char *begin = cursor.c_str();
+        const char *invalid = nullptr;
+        const char *stop = simd::scanString(begin, end, flags, &invalid);
+        if (invalid) {
+            int64_t at = cursor.idx + (invalid - begin);
+            cursor.fail("invalid utf-8 codepoint", at);
+            return;
+        }
+        out.append(begin, stop);
+        cursor.next(stop - begin);
+        if (cursor.peek() == '"') {
+            break;
+        }
+        if (cursor.eof()) {
+            cursor.fail("unterminated string");
+            return;
+        }
+        cursor.next();
+        switch (cursor.peek()) {
+            case '\\':
+                out += '\\';
+                break;
+            case '"':
+                out += '"';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case '/':
+                out += '/';
+                break;
+            case 'u':
+                utf8::unescapeCodepoint(cursor, out);
+                break;
+            default:
+                cursor.fail("invalid escape character");
+                return;
+        }
+        cursor.next();
+    }
+    cursor.expect('"');
 }
 
 template <typename T>
@@ -886,60 +3577,66 @@ void deserializeString(T &item, Cursor &cursor) {
             return;
         }
         else if (keyword.size()) {
-            throw exception("invalid keyword '" + keyword + "'", cursor.idx);
+            cursor.fail("invalid keyword '" + keyword + "'");
+            return;
         }
     }
-    cursor.expect('"');
-    int length = 0;
+    JSON_INSTRUMENT_COUNT(strings);
     std::string string;
-    while (cursor.peek() != '"') {
-        if (cursor.peek() == '\\') {
-            cursor.next();
-            switch (cursor.peek()) {
-                case '\\':
-                    string += '\\';
-                    break;
-                case '"':
-                    string += '"';
-                    break;
-                case 't':
-                    string += '\t';
-                    break;
-                case 'n':
-                    string += '\n';
-                    break;
-                case 'r':
-                    string += '\r';
-                    break;
-                case 'b':
-                    string += '\b';
-                    break;
-                case 'u': {
-                    try {
-                        string += utf8::unescapeCodepoint(cursor);
-                    }
-                    catch (const std::exception&) {
-                        throw exception("invalid utf-8 codepoint", cursor.idx);
-                    }
-                    break;
-                }
-                default:
-                    throw exception("invalid escape character", cursor.idx);
-            }
-        }
-        else {
-            string += cursor.peek();
-        }
-        cursor.next();
+    parseString(cursor, string);
+    if (cursor.failed()) {
+        return;
     }
-    cursor.expect('"');
     if constexpr (std::is_pointer<T>().value) {
         string += '\0';
         item = new char[string.size()];
         memcpy((void *)item, string.c_str(), string.size());
     }
     else {
-        item = string;
+        item = std::move(string);
+    }
+}
+
+inline void deserializeBytes(bytes &item, Cursor &cursor) {
+    JSON_INSTRUMENT_COUNT(strings);
+    int64_t start = cursor.idx;
+    cursor.expect('"');
+    if (cursor.failed()) {
+        return;
+    }
+    const char *begin = cursor.c_str();
+    const char *end = (const char *)memchr(begin, '"', cursor.remaining());
+    if (!end) {
+        cursor.fail("unterminated string");
+        return;
+    }
+    std::string_view text(begin, end - begin);
+    int64_t at = cursor.idx;
+    std::string unescaped;
+    if (memchr(begin, '\\', end - begin)) {
+        // some encoders escape '/', which needs the general string parser
+        cursor.idx = start;
+        parseString(cursor, unescaped);
+        text = unescaped;
+    }
+    else {
+        cursor.next(text.size() + 1);
+    }
+    if (cursor.failed()) {
+        return;
+    }
+    size_t size = base64::decodedSize(text.data(), text.size());
+    if (size == SIZE_MAX) {
+        cursor.fail("invalid base64 length", at);
+        return;
+    }
+    item.resize(size);
+    const char *invalid = base64::decode(text.data(), text.size(), item.data());
+    if (invalid) {
+        if (unescaped.empty()) {
+            at += invalid - text.data();
+        }
+        cursor.fail("invalid base64 character", at);
     }
 }
 
@@ -952,18 +3649,26 @@ inline void deserializeBool(bool &item, Cursor &cursor) {
         item = false;
     }
     else {
-        throw exception("invalid keyword '" + keyword + "'", cursor.idx);
+        cursor.fail("invalid keyword '" + keyword + "'");
     }
 }
 
 template <typename T, size_t N>
 void deserializeArray(T(&item)[N], Cursor &cursor) {
-    JsonArrayParser arrayParser(cursor);
-    arrayParser.start();
-    for (int i = 0; i < N && arrayParser.optionalNext(); i++) {
-        deserialize(item[i], cursor);
+    if constexpr (std::is_arithmetic<T>().value && !std::is_same<T, bool>().value) {
+        size_t i = 0;
+        deserializeNumbers<T>(cursor, N, [&](T value) {
+            item[i++] = value;
+        });
+    }
+    else {
+        JsonArrayParser arrayParser(cursor);
+        arrayParser.start();
+        for (int i = 0; i < N && arrayParser.optionalNext(); i++) {
+            deserialize(item[i], cursor);
+        }
+        arrayParser.finish();
     }
-    arrayParser.finish();
 }
 
 template <typename T>
@@ -987,47 +3692,13 @@ void deserializeEnum(T &item, Cursor &cursor) {
 
 template <typename T>
 void deserializeNumber(T &item, Cursor &cursor) {
-    int length = 0;
-    if (cursor.peek(length) == '-') {
-        length++;
-    }
-    while (isdigit(cursor.peek(length))) {
-        length++;
-    }
-    if constexpr (std::is_floating_point<T>().value) {
-        if (cursor.peek(length) == '.') {
-            length++;
-            while (isdigit(cursor.peek(length))) {
-                length++;
-            }
-            if (tolower(cursor.peek(length)) == 'e') {
-                length++;
-                if (cursor.peek(length) == '-') {
-                    length++;
-                }
-                while (isdigit(cursor.peek(length))) {
-                    length++;
-                }
-            }
-        }
-    }
-    std::string number = cursor.substr(length);
-    try {
-        if constexpr (std::is_floating_point<T>().value) {
-            item = (T)std::stold(number);
-        }
-        else if constexpr (std::is_signed<T>().value) {
-            item = (T)std::stoll(number);
-        }
-        else {
-            item = (T)std::stoull(number);
-        }
-    }
-    catch (const std::invalid_argument &) {
-        throw exception("invalid number", cursor.idx);
-    }
-    catch (const std::out_of_range &) {
-        throw exception("invalid number", cursor.idx);
+    JSON_INSTRUMENT_COUNT(numbers);
+    const char *begin = cursor.c_str();
+    const char *p = begin;
+    bool ok = parseNumber(p, begin + cursor.remaining(), item);
+    cursor.next(p - begin);
+    if (!ok) {
+        cursor.fail("invalid number");
     }
 }
 
@@ -1037,24 +3708,148 @@ inline void deserializeChar(char &item, Cursor &cursor) {
     item = value;
 }
 
+// returns the key at the cursor, viewing the input directly unless it
+// contains escapes, in which case it is unescaped into `scratch`
+inline std::string_view deserializeKey(Cursor &cursor, std::string &scratch) {
+    if (cursor.peek() == '"') {
+        const char *begin = cursor.c_str() + 1;
+        const char *end = cursor.string.data() + cursor.string.size();
+        int flags = cursor.options.validateUtf8 ? simd::VALIDATE_UTF8 : 0;
+        const char *invalid = nullptr;
+        const char *stop = simd::scanString(begin, end, flags, &invalid);
+        if (!invalid && stop < end && *stop == '"') {
+            cursor.next(stop - begin + 2);
+            return std::string_view(begin, stop - begin);
+        }
+    }
+    deserialize(scratch, cursor);
+    return scratch;
+}
+
+template <typename T>
+void deserializeField(T &item, Cursor &cursor, SeenFields<T> &seen) {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    std::string scratch;
+    int64_t keyIdx = cursor.idx;
+    std::string_view key = deserializeKey(cursor, scratch);
+    JsonObjectParser(cursor).value();
+    if (cursor.failed()) {
+        return;
+    }
+    uint32_t keyHash = fnv1a(key);
+    bool found = false;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        constexpr auto property = std::get<i>(properties<T>());
+        constexpr std::string_view name = property.key;
+        if (!found && keyHash == fnv1a(name) && key == name) {
+            found = true;
+            markSeen<T, i>(seen);
+            deserialize(item.*(property.value), cursor);
+        }
+    });
+    if (!found) {
+        cursor.fail("unknown key '" + std::string(key) + "'", keyIdx);
+    }
+}
+
 template <typename T>
 void deserializeClass(T &item, Cursor &cursor) {
     constexpr auto props = properties<T>();
     constexpr auto size = std::tuple_size<decltype(props)>::value;
     JsonObjectParser objectParser(cursor);
     objectParser.start();
-    while (objectParser.optionalNext()) {
-        std::string key;
-        deserialize(key, cursor);
+    SeenFields<T> seen{};
+    bool more = objectParser.optionalNext();
+    // our own serializer writes fields in declaration order, so first expect
+    // field i at position i and match its key with a single memcmp. the
+    // first field out of place falls back to looking keys up by hash.
+    bool inOrder = true;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        if (!more || !inOrder) {
+            return;
+        }
+        constexpr auto property = std::get<i>(properties<T>());
+        static constexpr auto fragment = keyFragment<T, i>();
+        if (cursor.remaining() < fragment.size()
+                || memcmp(cursor.c_str(), fragment.data(), fragment.size())) {
+            // an omittable field may just have been left out
+            inOrder = fieldPolicy<T, i>() != OMIT_NEVER;
+            return;
+        }
+        cursor.next(fragment.size());
+        cursor.skipWhitespaceAndComments();
+        markSeen<T, i>(seen);
+        deserialize(item.*(property.value), cursor);
+        more = objectParser.optionalNext();
+    });
+    while (more) {
+        deserializeField(item, cursor, seen);
+        more = objectParser.optionalNext();
+    }
+    objectParser.finish();
+    resetOmittedFields(item, seen);
+}
+
+inline void skipValue(Cursor &cursor) {
+    cursor.skipWhitespaceAndComments();
+    const char *end = cursor.string.data() + cursor.string.size();
+    const char *p = simd::skipValue(cursor.c_str(), end);
+    if (p == cursor.c_str()) {
+        cursor.fail("expected value");
+        return;
+    }
+    cursor.next(p - cursor.c_str());
+}
+
+// deserializes only the fields of T selected by `Fields`, skipping every
+// other value by its brackets and quotes alone. returns true when it
+// stopped at the last selected field, leaving the rest of the object
+// unread (and unchecked).
+template <typename T, typename Fields>
+bool deserializeProjection(T &item, Cursor &cursor) {
+    static_assert(isProjection<T>(Fields()),
+        "json::fields<> may only name REFLECTed members of the class");
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    constexpr size_t selected = [] {
+        size_t count = 0;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            count += selectsField<T, i>(Fields());
+        });
+        return count;
+    }();
+    bool seen[size + 1] = {};
+    size_t remaining = selected;
+    std::string scratch;
+    JsonObjectParser objectParser(cursor);
+    objectParser.start();
+    while (remaining && objectParser.optionalNext()) {
+        std::string_view key = deserializeKey(cursor, scratch);
         objectParser.value();
+        if (cursor.failed()) {
+            return false;
+        }
+        uint32_t keyHash = fnv1a(key);
+        bool found = false;
         for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
-            constexpr auto property = std::get<i>(properties<T>());
-            if (strcmp(property.key, key.c_str()) == 0) {
-                deserialize(item.*(property.value), cursor);
+            if constexpr (selectsField<T, i>(Fields())) {
+                constexpr std::string_view name = std::get<i>(properties<T>()).key;
+                if (!found && keyHash == fnv1a(name) && key == name) {
+                    found = true;
+                    deserialize(item.*(std::get<i>(properties<T>()).value), cursor);
+                    remaining -= !seen[i];
+                    seen[i] = true;
+                }
             }
         });
+        if (!found) {
+            skipValue(cursor);
+        }
+    }
+    if (!remaining && !cursor.failed()) {
+        return true;
     }
     objectParser.finish();
+    return false;
 }
 
 template <typename T>
@@ -1101,6 +3896,12 @@ void deserialize(T &item, Cursor &cursor) {
     else if constexpr (is_specialization<T, std::unordered_map>().value) {
         deserializeMap(item, cursor);
     }
+    else if constexpr (isFlatMap<T>()) {
+        deserializeFlatMap(item, cursor);
+    }
+    else if constexpr (isFlatSet<T>()) {
+        deserializeFlatSet(item, cursor);
+    }
     else if constexpr (std::is_same<T, std::string>().value) {
         deserializeString(item, cursor);
     }
@@ -1128,105 +3929,4526 @@ void deserialize(T &item, Cursor &cursor) {
     else if constexpr (std::is_arithmetic<T>().value) {
         deserializeNumber(item, cursor);
     }
+    else if constexpr (std::is_same<T, document>().value) {
+        deserializeDocument(item, cursor);
+    }
+    else if constexpr (std::is_same<T, bytes>().value) {
+        deserializeBytes(item, cursor);
+    }
     else if constexpr (std::is_class<T>().value) {
+        JSON_INSTRUMENT_BEGIN(DESERIALIZE, T, false, cursor.idx);
         deserializeClass(item, cursor);
+        JSON_INSTRUMENT_END(cursor.idx);
     }
 }
 // }}}
 // DESERIALIZATION HELPERS IMPLEMENTATION {{{
+// custom deserializers may still report errors by throwing
+template <typename F>
+void catchErrors(Cursor &cursor, F &&parse) {
+#if JSON_EXCEPTIONS
+    try {
+        parse();
+    }
+    catch (const exception &ex) {
+        cursor.fail(ex.description, ex.idx);
+    }
+#else
+    parse();
+#endif
+}
+
 template <typename T>
-void deserialize(T &item, const std::string &json) {
-    Cursor cursor(json);
-    deserialize(item, cursor);
-    cursor.skipWhitespaceAndComments();
-    if (cursor.peek()) {
-        throw exception("expected EOF", cursor.idx);
+error try_deserialize(
+    T &item, std::string_view json, const Options &options = Options()
+) {
+    Cursor cursor(json, options);
+    JSON_INSTRUMENT_BEGIN(DESERIALIZE, T, true, 0);
+    catchErrors(cursor, [&] {
+        deserialize(item, cursor);
+    });
+    if (!cursor.failed()) {
+        cursor.skipWhitespaceAndComments();
+        if (!cursor.eof()) {
+            cursor.fail("expected EOF");
+        }
+    }
+    JSON_INSTRUMENT_END(cursor.idx);
+    return cursor.error;
+}
+
+template <typename T>
+result<T> try_deserialize(
+    std::string_view json, const Options &options = Options()
+) {
+    result<T> res;
+    res.error = try_deserialize(res.value, json, options);
+    return res;
+}
+
+template <typename T>
+void deserialize(T &item, std::string_view json, const Options &options) {
+    error err = try_deserialize(item, json, options);
+    if (err) {
+        throwError(err);
     }
 }
 
 template <typename T>
-T deserialize(const std::string &json) {
-    T item;
-    deserialize(item, json);
+T deserialize(std::string_view json, const Options &options) {
+    T item{};
+    deserialize(item, json, options);
     return item;
 }
+
+// a sparse read of the object in `json`: only the members selected by
+// `Fields` are populated, the rest keep their default values
+template <typename T, typename Fields>
+result<T> try_deserialize(
+    std::string_view json, const Options &options = Options()
+) {
+    static_assert(!std::is_void<decltype(properties<T>())>::value,
+        "projection needs a REFLECTed class");
+    result<T> res;
+    Cursor cursor(json, options);
+    JSON_INSTRUMENT_BEGIN(DESERIALIZE, T, true, 0);
+    bool stopped = false;
+    catchErrors(cursor, [&] {
+        stopped = deserializeProjection<T, Fields>(res.value, cursor);
+    });
+    if (!cursor.failed() && !stopped) {
+        cursor.skipWhitespaceAndComments();
+        if (!cursor.eof()) {
+            cursor.fail("expected EOF");
+        }
+    }
+    JSON_INSTRUMENT_END(cursor.idx);
+    res.error = cursor.error;
+    return res;
+}
+
+template <typename T, typename Fields>
+T deserialize(std::string_view json, const Options &options = Options()) {
+    result<T> res = try_deserialize<T, Fields>(json, options);
+    if (res.error) {
+        throwError(res.error);
+    }
+    return std::move(res.value);
+}
 // }}}
-// JSON PRETTIFIER {{{
-class Prettifier
+// DOCUMENT {{{
+// a json text of any shape, for payloads without a REFLECTed type. parsing
+// appends every value to one flat array of nodes in document order, and
+// every string to one character buffer, so a node costs no allocation of
+// its own. containers know their length and the size of their subtree, so
+// walking their children is a forward scan over adjacent nodes. lengths
+// are 32 bits, and parsing fails on a longer string or container.
+enum class Type { NIL, BOOLEAN, INTEGER, UNSIGNED, FLOAT, STRING, ARRAY, OBJECT };
+
+struct ValueNode {
+    Type type;
+    // elements of an array, members of an object, bytes of a string
+    uint32_t size;
+    union {
+        bool boolean;
+        int64_t integer;
+        // only used for integers above INT64_MAX
+        uint64_t uinteger;
+        double number;
+        // of a string, into the string buffer
+        uint64_t offset;
+        // of a container, the number of nodes in its subtree including itself
+        uint64_t nodes;
+    };
+};
+
+// the node after `node` and all of its descendants
+inline const ValueNode *skipNode(const ValueNode *node) {
+    bool container = node->type == Type::ARRAY || node->type == Type::OBJECT;
+    return container ? node + node->nodes : node + 1;
+}
+
+// a read-only handle on one node of a document, valid until the document is
+// parsed into again or destroyed
+class value
 {
-    int m_indent;
+    const ValueNode *m_node = nullptr;
+    const char *m_strings = nullptr;
+
+    [[noreturn]] void mismatch(const char *expected) const {
+        throwError({std::string("value is not ") + expected, 0});
+    }
 
 public:
-    Prettifier() : m_indent(4) {}
-    Prettifier(int indent) : m_indent(indent) {}
+    struct member;
 
-    void setIndent(int indent) {
-        m_indent = indent;
+    // walks the elements of an array, or the members of an object
+    template <typename T>
+    class Iterator
+    {
+        const ValueNode *m_node;
+        const char *m_strings;
+
+    public:
+        Iterator(const ValueNode *node, const char *strings)
+            : m_node(node), m_strings(strings) {}
+
+        T operator*() const {
+            if constexpr (std::is_same<T, member>().value) {
+                return {
+                    value(m_node, m_strings).string(),
+                    value(m_node + 1, m_strings)
+                };
+            }
+            else {
+                return value(m_node, m_strings);
+            }
+        }
+
+        Iterator &operator++() {
+            if constexpr (std::is_same<T, member>().value) {
+                m_node = skipNode(m_node + 1);
+            }
+            else {
+                m_node = skipNode(m_node);
+            }
+            return *this;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return m_node == other.m_node;
+        }
+    };
+
+    template <typename T>
+    struct Range {
+        Iterator<T> first;
+        Iterator<T> last;
+
+        Iterator<T> begin() const {
+            return first;
+        }
+
+        Iterator<T> end() const {
+            return last;
+        }
+    };
+
+    value() = default;
+    value(const ValueNode *node, const char *strings)
+        : m_node(node), m_strings(strings) {}
+
+    Type type() const {
+        return m_node->type;
     }
 
-    std::string prettify(std::string json) {
-        std::string prettyJson;
-        int depth = 0;
-        for (int i = 0; i < json.size(); i++) {
-            switch (json[i]) {
-                case ' ':
-                case '\t':
-                case '\n':
-                    break;
-                case '"':
-                    prettyJson += json[i];
-                    while (json[++i] != '"') {
-                        prettyJson += json[i];
-                        if (json[i] == '\\') {
-                            prettyJson += json[++i];
-                        }
-                    }
-                    prettyJson += json[i];
-                    break;
-                case '[':
-                case '{':
-                    prettyJson += json[i];
-                    while (isspace(json[i + 1])) {
-                        i++;
-                    }
-                    if (json[i + 1] == '}' || json[i + 1] == ']') {
-                        prettyJson += json[++i];
-                    }
-                    else {
-                        prettyJson += '\n';
-                        depth++;
-                        for (int j = 0; j < depth * m_indent; j++) {
-                            prettyJson += ' ';
-                        }
-                    }
-                    break;
-                case ']':
-                case '}':
-                    depth--;
-                    prettyJson += '\n';
-                    for (int j = 0; j < depth * m_indent; j++) {
-                        prettyJson += ' ';
-                    }
-                    prettyJson += json[i];
-                    break;
-                case ':':
-                    prettyJson += json[i];
-                    prettyJson += ' ';
-                    break;
-                case ',':
-                    prettyJson += json[i];
-                    prettyJson += '\n';
-                    for (int j = 0; j < depth * m_indent; j++) {
-                        prettyJson += ' ';
-                    }
-                    break;
+    bool isNull() const {
+        return m_node->type == Type::NIL;
+    }
+
+    bool isNumber() const {
+        return m_node->type == Type::INTEGER || m_node->type == Type::UNSIGNED
+            || m_node->type == Type::FLOAT;
+    }
+
+    // elements of an array, members of an object or bytes of a string, in O(1)
+    size_t size() const {
+        return m_node->size;
+    }
+
+    bool empty() const {
+        return !m_node->size;
+    }
+
+    std::string_view string() const {
+        if (m_node->type != Type::STRING) {
+            mismatch("a string");
+        }
+        return {m_strings + m_node->offset, m_node->size};
+    }
+
+    // converts a bool, number or string, throwing if the type differs or a
+    // number does not fit in T
+    template <typename T>
+    T get() const {
+        if constexpr (std::is_same<T, bool>().value) {
+            if (m_node->type != Type::BOOLEAN) {
+                mismatch("a bool");
+            }
+            return m_node->boolean;
+        }
+        else if constexpr (std::is_integral<T>().value) {
+            if (m_node->type == Type::INTEGER) {
+                int64_t n = m_node->integer;
+                if (n >= 0 ? (uint64_t)n <= (uint64_t)std::numeric_limits<T>::max()
+                        : std::is_signed<T>().value
+                            && n >= (int64_t)std::numeric_limits<T>::min()) {
+                    return (T)n;
+                }
+            }
+            else if (m_node->type == Type::UNSIGNED) {
+                if (m_node->uinteger <= (uint64_t)std::numeric_limits<T>::max()) {
+                    return (T)m_node->uinteger;
+                }
+            }
+            mismatch("an integer in range");
+        }
+        else if constexpr (std::is_floating_point<T>().value) {
+            switch (m_node->type) {
+                case Type::INTEGER:
+                    return (T)m_node->integer;
+                case Type::UNSIGNED:
+                    return (T)m_node->uinteger;
+                case Type::FLOAT:
+                    return (T)m_node->number;
                 default:
-                    prettyJson += json[i];
-                    break;
+                    mismatch("a number");
+            }
+        }
+        else if constexpr (std::is_same<T, std::string_view>().value) {
+            return string();
+        }
+        else if constexpr (std::is_same<T, std::string>().value) {
+            return std::string(string());
+        }
+        else {
+            static_assert(!sizeof(T), "unsupported value type");
+        }
+    }
+
+    Range<value> elements() const {
+        if (m_node->type != Type::ARRAY) {
+            mismatch("an array");
+        }
+        return {{m_node + 1, m_strings}, {skipNode(m_node), m_strings}};
+    }
+
+    Range<member> members() const {
+        if (m_node->type != Type::OBJECT) {
+            mismatch("an object");
+        }
+        return {{m_node + 1, m_strings}, {skipNode(m_node), m_strings}};
+    }
+
+    Iterator<value> begin() const {
+        return elements().begin();
+    }
+
+    Iterator<value> end() const {
+        return elements().end();
+    }
+
+    // element `i` of an array, found by skipping the ones before it
+    value operator[](size_t i) const {
+        if (i >= size()) {
+            throwError({"index out of range", 0});
+        }
+        Iterator<value> it = begin();
+        while (i--) {
+            ++it;
+        }
+        return *it;
+    }
+
+    // the first member named `key`, if any
+    std::optional<value> find(std::string_view key) const;
+
+    value operator[](std::string_view key) const {
+        std::optional<value> found = find(key);
+        if (!found) {
+            throwError({"missing key '" + std::string(key) + "'", 0});
+        }
+        return *found;
+    }
+};
+
+struct value::member {
+    std::string_view key;
+    json::value value;
+};
+
+inline std::optional<value> value::find(std::string_view key) const {
+    for (member m : members()) {
+        if (m.key == key) {
+            return m.value;
+        }
+    }
+    return std::nullopt;
+}
+
+// the deepest nesting of arrays and objects that a document is parsed
+// with, or that validate() accepts
+constexpr int MAX_VALIDATE_DEPTH = 4096;
+
+class document
+{
+    std::vector<ValueNode> m_nodes;
+    std::string m_strings;
+    // the nodes of the containers being parsed, innermost last
+    std::vector<size_t> m_open;
+
+    friend void deserializeDocument(document &item, Cursor &cursor);
+
+    void parseValue(Cursor &cursor);
+
+    void parseStringNode(Cursor &cursor) {
+        JSON_INSTRUMENT_COUNT(strings);
+        size_t offset = m_strings.size();
+        parseString(cursor, m_strings);
+        if (m_strings.size() - offset > UINT32_MAX) {
+            cursor.fail("string too long for a document");
+            return;
+        }
+        ValueNode &node = m_nodes[push(Type::STRING)];
+        node.offset = offset;
+        node.size = (uint32_t)(m_strings.size() - offset);
+    }
+
+    size_t push(Type type) {
+        m_nodes.push_back(ValueNode{type, 0, {}});
+        return m_nodes.size() - 1;
+    }
+
+    void parseNumber(Cursor &cursor) {
+        JSON_INSTRUMENT_COUNT(numbers);
+        const char *begin = cursor.c_str();
+        const char *end = begin + cursor.remaining();
+        const char *p = begin;
+        bool integral = true;
+        while (p < end && (isdigit((unsigned char)*p) || *p == '-' || *p == '+'
+                || *p == '.' || *p == 'e' || *p == 'E')) {
+            integral = integral && *p != '.' && *p != 'e' && *p != 'E';
+            p++;
+        }
+        ValueNode &node = m_nodes[push(Type::INTEGER)];
+        p = begin;
+        if (integral && json::parseNumber(p, end, node.integer)) {
+            cursor.next(p - begin);
+            return;
+        }
+        p = begin;
+        if (integral && *p != '-' && json::parseNumber(p, end, node.uinteger)) {
+            node.type = Type::UNSIGNED;
+            cursor.next(p - begin);
+            return;
+        }
+        // fractions, exponents and integers beyond 64 bits
+        p = begin;
+        node.type = Type::FLOAT;
+        bool ok = json::parseNumber(p, end, node.number);
+        cursor.next(p - begin);
+        if (!ok) {
+            cursor.fail("invalid number");
+        }
+    }
+
+public:
+    // the root value, valid until the document is parsed into again. an
+    // empty document has a null root.
+    value root() const {
+        static const ValueNode nil{Type::NIL, 0, {}};
+        if (m_nodes.empty()) {
+            return value(&nil, nullptr);
+        }
+        return value(m_nodes.data(), m_strings.data());
+    }
+
+    bool empty() const {
+        return m_nodes.empty();
+    }
+
+    // keeps the capacity for the next parse
+    void clear() {
+        m_nodes.clear();
+        m_strings.clear();
+    }
+};
+
+// containers are tracked on m_open rather than the call stack, so that
+// hostile nesting fails at MAX_VALIDATE_DEPTH instead of overflowing it
+inline void document::parseValue(Cursor &cursor) {
+    auto memberKey = [&] {
+        cursor.skipWhitespaceAndComments();
+        parseStringNode(cursor);
+        cursor.skipWhitespaceAndComments();
+        cursor.expect(':');
+    };
+    m_open.clear();
+    while (!cursor.failed()) {
+        cursor.skipWhitespaceAndComments();
+        char c = cursor.peek();
+        if (c == '[' || c == '{') {
+            if (m_open.size() == MAX_VALIDATE_DEPTH) {
+                cursor.fail("nesting too deep");
+                return;
+            }
+            bool object = c == '{';
+            size_t index = push(object ? Type::OBJECT : Type::ARRAY);
+            cursor.next();
+            JSON_INSTRUMENT_ENTER();
+            cursor.skipWhitespaceAndComments();
+            if (cursor.peek() != (object ? '}' : ']')) {
+                m_open.push_back(index);
+                if (object) {
+                    memberKey();
+                }
+                // continue with the first element
+                continue;
+            }
+            cursor.next();
+            JSON_INSTRUMENT_LEAVE();
+            m_nodes[index].nodes = 1;
+        }
+        else if (c == '"') {
+            parseStringNode(cursor);
+        }
+        else if (c == '-' || isdigit((unsigned char)c)) {
+            parseNumber(cursor);
+        }
+        else {
+            std::string keyword = cursor.getKeyword();
+            if (keyword == "null") {
+                push(Type::NIL);
+            }
+            else if (keyword == "true" || keyword == "false") {
+                m_nodes[push(Type::BOOLEAN)].boolean = keyword == "true";
+            }
+            else if (keyword.size()) {
+                cursor.fail("invalid keyword '" + keyword + "'");
+            }
+            else {
+                cursor.fail("expected value");
+            }
+        }
+        // a value is complete, so count it in its container and close
+        // every container it completes
+        while (!m_open.empty() && !cursor.failed()) {
+            size_t index = m_open.back();
+            ValueNode &node = m_nodes[index];
+            bool object = node.type == Type::OBJECT;
+            if (node.size == UINT32_MAX) {
+                cursor.fail(object ? "object too long for a document"
+                    : "array too long for a document");
+                return;
+            }
+            node.size++;
+            cursor.skipWhitespaceAndComments();
+            if (cursor.peek() != (object ? '}' : ']')) {
+                cursor.expect(',');
+                if (object) {
+                    memberKey();
+                }
+                break;
             }
+            cursor.next();
+            node.nodes = m_nodes.size() - index;
+            m_open.pop_back();
+            JSON_INSTRUMENT_LEAVE();
+        }
+        if (m_open.empty()) {
+            return;
         }
-        return prettyJson;
     }
+}
+
+inline void deserializeDocument(document &item, Cursor &cursor) {
+    item.clear();
+    item.parseValue(cursor);
+    if (cursor.failed()) {
+        item.clear();
+    }
+}
+
+inline void serializeDocument(const value &item, Writer &writer) {
+    switch (item.type()) {
+        case Type::NIL:
+            writer.write("null");
+            break;
+        case Type::BOOLEAN:
+            writer.write(item.get<bool>() ? "true" : "false");
+            break;
+        case Type::INTEGER:
+            serializeNumber(item.get<int64_t>(), writer);
+            break;
+        case Type::UNSIGNED:
+            serializeNumber(item.get<uint64_t>(), writer);
+            break;
+        case Type::FLOAT: {
+            // the shortest text that parses back to the same double
+            JSON_INSTRUMENT_COUNT(numbers);
+            char *out = writer.reserve(64);
+            double number = item.get<double>();
+            if (writer.options.canonical) {
+                writer.advance(writeCanonicalNumber(number, out));
+            }
+            else {
+                writer.advance(std::to_chars(out, out + 64, number).ptr);
+            }
+            break;
+        }
+        case Type::STRING:
+            serializeString(item.string(), writer);
+            break;
+        case Type::ARRAY: {
+            JsonArrayWriter array(writer);
+            array.start();
+            for (value element : item.elements()) {
+                array.next();
+                serializeDocument(element, writer);
+            }
+            array.finish();
+            break;
+        }
+        case Type::OBJECT: {
+            JsonObjectWriter object(writer);
+            object.start();
+            auto write = [&](const value::member &member) {
+                object.next();
+                serializeString(member.key, writer);
+                object.value();
+                serializeDocument(member.value, writer);
+            };
+            if (writer.options.canonical) {
+                // members are two small handles, cheap to sort directly
+                forEachSorted<value::member>(item.members(), item.size(),
+                    [](const value::member &member) { return member; },
+                    [](const value::member &lhs, const value::member &rhs) {
+                        return lhs.key < rhs.key;
+                    },
+                    write);
+            }
+            else {
+                for (value::member member : item.members()) {
+                    write(member);
+                }
+            }
+            object.finish();
+            break;
+        }
+    }
+}
+
+inline void serializeDocument(const document &item, Writer &writer) {
+    if (item.empty()) {
+        writer.write("null");
+        return;
+    }
+    serializeDocument(item.root(), writer);
+}
+// }}}
+// VALIDATE {{{
+// checks json text without building anything. validate() accepts any value
+// in the strict grammar of rfc 8259, with well-formed utf-8 and escapes and
+// no comments, and walks containers with a fixed stack so hostile nesting
+// cannot overflow the call stack. validate<T>() follows the shape of T the
+// way deserialize() would, down to field names, arities and number ranges,
+// with the same strict whitespace. neither allocates unless the input is
+// invalid, and then only for the error description.
+
+// skips a string literal. unlike deserializing it requires well-formed
+// utf-8 and rejects raw control characters.
+inline void validateStringLiteral(Cursor &cursor) {
+    cursor.expect('"');
+    const char *end = cursor.string.data() + cursor.string.size();
+    int flags = simd::STOP_CONTROL | simd::VALIDATE_UTF8;
+    while (!cursor.failed()) {
+        const char *begin = cursor.c_str();
+        const char *invalid = nullptr;
+        const char *stop = simd::scanString(begin, end, flags, &invalid);
+        if (invalid) {
+            cursor.fail("invalid utf-8 codepoint", cursor.idx + (invalid - begin));
+            return;
+        }
+        cursor.next(stop - begin);
+        if (cursor.eof()) {
+            cursor.fail("unterminated string");
+            return;
+        }
+        char c = cursor.peek();
+        if (c == '"') {
+            break;
+        }
+        if (c == 0x7f) {
+            cursor.next();
+            continue;
+        }
+        if (c != '\\') {
+            cursor.fail("unescaped control character");
+            return;
+        }
+        cursor.next();
+        switch (cursor.peek()) {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                break;
+            case 'u': {
+                char buf[4];
+                utf8::unescapeCodepoint(cursor, buf);
+                break;
+            }
+            default:
+                cursor.fail("invalid escape character");
+                return;
+        }
+        cursor.next();
+    }
+    cursor.expect('"');
+}
+
+// skips a number in the strict json grammar
+inline void validateNumberLiteral(Cursor &cursor) {
+    const char *begin = cursor.c_str();
+    const char *end = begin + cursor.remaining();
+    const char *p = begin;
+    auto digits = [&] {
+        const char *start = p;
+        while (p < end && (unsigned char)(*p - '0') < 10) {
+            p++;
+        }
+        return p > start;
+    };
+    p += p < end && *p == '-';
+    bool ok;
+    if (p < end && *p == '0') {
+        p++;
+        ok = true;
+    }
+    else {
+        ok = digits();
+    }
+    if (ok && p < end && *p == '.') {
+        p++;
+        ok = digits();
+    }
+    if (ok && p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        p += p < end && (*p == '+' || *p == '-');
+        ok = digits();
+    }
+    cursor.next(p - begin);
+    if (!ok) {
+        cursor.fail("invalid number");
+    }
+}
+
+// skips `keyword`, comparing it with the whole word at the cursor
+inline bool matchKeyword(Cursor &cursor, std::string_view keyword) {
+    size_t size = 0;
+    while (isalpha((unsigned char)cursor.peek(size))) {
+        size++;
+    }
+    if (size != keyword.size() || memcmp(cursor.c_str(), keyword.data(), size)) {
+        return false;
+    }
+    cursor.next(size);
+    return true;
+}
+
+inline void validateKeyword(Cursor &cursor) {
+    if (!matchKeyword(cursor, "true") && !matchKeyword(cursor, "false")
+            && !matchKeyword(cursor, "null")) {
+        std::string keyword = cursor.peekKeyword();
+        cursor.fail(keyword.size() ? "invalid keyword '" + keyword + "'"
+            : std::string("expected value"));
+    }
+}
+
+// runs sax::parse with no events, the one state machine for arbitrary json
+inline void validateAny(Cursor &cursor);
+
+template <typename T>
+void validateAs(Cursor &cursor);
+
+// checks that a base64 string decodes, when it has no escapes
+inline void validateBase64(Cursor &cursor) {
+    int64_t start = cursor.idx;
+    validateStringLiteral(cursor);
+    if (cursor.failed()) {
+        return;
+    }
+    const char *data = cursor.string.data() + start + 1;
+    size_t size = cursor.idx - start - 2;
+    if (memchr(data, '\\', size)) {
+        return;
+    }
+    if (base64::decodedSize(data, size) == SIZE_MAX) {
+        cursor.fail("invalid base64 length", start + 1);
+        return;
+    }
+    while (size && data[size - 1] == '=') {
+        size--;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (base64::VALUES[(unsigned char)data[i]] < 0) {
+            cursor.fail("invalid base64 character", start + 1 + i);
+            return;
+        }
+    }
+}
+
+template <typename T>
+void validateSequence(Cursor &cursor) {
+    JsonArrayParser arrayParser(cursor);
+    arrayParser.start();
+    while (arrayParser.optionalNext()) {
+        validateAs<T>(cursor);
+    }
+    arrayParser.finish();
+}
+
+template <typename Key, typename Value>
+void validateMap(Cursor &cursor) {
+    JsonObjectParser objectParser(cursor);
+    objectParser.start();
+    while (objectParser.optionalNext()) {
+        if constexpr (std::is_same<Key, std::string>().value
+                || std::is_same<Key, char *>().value
+                || std::is_same<Key, const char *>().value) {
+            validateStringLiteral(cursor);
+        }
+        else {
+            Key key{};
+            deserializeKey(key, cursor);
+        }
+        objectParser.value();
+        validateAs<Value>(cursor);
+    }
+    objectParser.finish();
+}
+
+template <typename T>
+void validateClass(Cursor &cursor) {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    JsonObjectParser objectParser(cursor);
+    objectParser.start();
+    std::string scratch;
+    while (objectParser.optionalNext()) {
+        int64_t keyIdx = cursor.idx;
+        validateStringLiteral(cursor);
+        std::string_view key = cursor.string.substr(
+            keyIdx + 1, cursor.idx - keyIdx - 2);
+        objectParser.value();
+        if (cursor.failed()) {
+            return;
+        }
+        if (key.find('\\') != std::string_view::npos) {
+            // escaped keys are rare enough to unescape the slow way
+            Cursor unescaper(cursor.string.substr(keyIdx), cursor.options);
+            // parseString appends
+            scratch.clear();
+            parseString(unescaper, scratch);
+            key = scratch;
+        }
+        uint32_t keyHash = fnv1a(key);
+        bool found = false;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            constexpr auto property = std::get<i>(properties<T>());
+            constexpr std::string_view name = property.key;
+            using Type = typename decltype(property)::Type;
+            if (!found && keyHash == fnv1a(name) && key == name) {
+                found = true;
+                validateAs<Type>(cursor);
+            }
+        });
+        if (!found) {
+            cursor.fail("unknown key '" + std::string(key) + "'", keyIdx);
+        }
+    }
+    objectParser.finish();
+}
+
+template <typename T>
+void validateAs(Cursor &cursor) {
+    cursor.skipWhitespaceAndComments();
+    if constexpr (is_specialization<T, std::unique_ptr>().value
+            || is_specialization<T, std::optional>().value
+            || (std::is_pointer<T>().value
+                && !std::is_same<T, char *>().value
+                && !std::is_same<T, const char *>().value)) {
+        if (!matchKeyword(cursor, "null")) {
+            using Type = typename std::decay<decltype(*std::declval<T>())>::type;
+            validateAs<Type>(cursor);
+        }
+    }
+    else if constexpr (is_specialization<T, std::pair>().value) {
+        JsonArrayParser arrayParser(cursor);
+        arrayParser.start();
+        arrayParser.next();
+        validateAs<typename T::first_type>(cursor);
+        arrayParser.next();
+        validateAs<typename T::second_type>(cursor);
+        arrayParser.finish();
+    }
+    else if constexpr (is_specialization<T, std::tuple>().value) {
+        JsonArrayParser arrayParser(cursor);
+        arrayParser.start();
+        for_sequence(std::make_index_sequence<std::tuple_size<T>::value>{},
+            [&](auto i) {
+                arrayParser.next();
+                validateAs<typename std::tuple_element<i, T>::type>(cursor);
+            });
+        arrayParser.finish();
+    }
+    else if constexpr (std::is_same<T, bytes>().value) {
+        validateBase64(cursor);
+    }
+    else if constexpr (is_specialization<T, std::vector>().value
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::queue>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value
+            || isFlatSet<T>()) {
+        validateSequence<typename T::value_type>(cursor);
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value
+            || isFlatMap<T>()) {
+        validateMap<typename T::key_type, typename T::mapped_type>(cursor);
+    }
+    else if constexpr (std::is_same<T, std::string>().value) {
+        validateStringLiteral(cursor);
+    }
+    else if constexpr (std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        if (!matchKeyword(cursor, "null")) {
+            validateStringLiteral(cursor);
+        }
+    }
+    else if constexpr (std::is_array<T>().value) {
+        JsonArrayParser arrayParser(cursor);
+        arrayParser.start();
+        for (size_t i = 0; i < std::extent<T>::value && arrayParser.optionalNext(); i++) {
+            validateAs<typename std::remove_extent<T>::type>(cursor);
+        }
+        arrayParser.finish();
+    }
+    else if constexpr (std::is_same<T, bool>().value) {
+        if (!matchKeyword(cursor, "true") && !matchKeyword(cursor, "false")) {
+            cursor.fail("invalid keyword '" + cursor.peekKeyword() + "'");
+        }
+    }
+    else if constexpr (std::is_enum<T>().value) {
+        validateAs<typename std::underlying_type<T>::type>(cursor);
+    }
+    else if constexpr (std::is_arithmetic<T>().value) {
+        // the strict grammar first, then the same parse deserialize() does
+        // for its range checks, which accepts more
+        int64_t start = cursor.idx;
+        validateNumberLiteral(cursor);
+        if (cursor.failed()) {
+            return;
+        }
+        int64_t end = cursor.idx;
+        cursor.idx = start;
+        T value;
+        deserializeNumber(value, cursor);
+        // where it stops short, deserialize() fails there too
+        if (!cursor.failed() && cursor.idx > end) {
+            cursor.idx = end;
+        }
+    }
+    else if constexpr (std::is_same<T, document>().value) {
+        validateAny(cursor);
+    }
+    else if constexpr (isReflected<T>()) {
+        validateClass<T>(cursor);
+    }
+    else {
+        // a custom deserializer defines its own grammar, so run it
+        T item{};
+        deserialize(item, cursor);
+    }
+}
+
+inline error validate(std::string_view json, const Options &options = Options()) {
+    Cursor cursor(json, options);
+    cursor.strict = true;
+    validateAny(cursor);
+    if (!cursor.failed()) {
+        cursor.skipWhitespaceAndComments();
+        if (!cursor.eof()) {
+            cursor.fail("expected EOF");
+        }
+    }
+    return cursor.error;
+}
+
+template <typename T>
+error validate(std::string_view json, const Options &options = Options()) {
+    Cursor cursor(json, options);
+    cursor.strict = true;
+    catchErrors(cursor, [&] {
+        validateAs<T>(cursor);
+    });
+    if (!cursor.failed()) {
+        cursor.skipWhitespaceAndComments();
+        if (!cursor.eof()) {
+            cursor.fail("expected EOF");
+        }
+    }
+    return cursor.error;
+}
+// }}}
+// SAX {{{
+// parses json into a stream of calls on a handler, without building any
+// values. a handler has any of:
+//
+//     start_object()  end_object()  key(std::string_view)
+//     start_array()   end_array()   string(std::string_view)
+//     number(std::string_view raw)  boolean(bool)  null()
+//
+// events without a member are skipped, and a member returning false stops
+// parsing. strings and keys view the input when they have no escapes, and
+// a buffer reused for the next string otherwise, so they are only valid
+// during the call. numbers are the raw text of the literal. on a strict
+// cursor strings are checked as validate() checks them.
+namespace sax {
+
+// calls `event`, failing when it returns false
+template <typename Event>
+void emit(Cursor &cursor, Event event) {
+    if constexpr (std::is_same<decltype(event()), bool>().value) {
+        if (!event()) {
+            cursor.fail("stopped by the handler");
+        }
+    }
+    else {
+        event();
+    }
+}
+
+// reads a string literal, unescaping it only when `Wanted`
+template <bool Wanted>
+std::string_view readString(Cursor &cursor, std::string &scratch) {
+    if (!cursor.strict) {
+        return deserializeKey(cursor, scratch);
+    }
+    int64_t start = cursor.idx;
+    validateStringLiteral(cursor);
+    if (!Wanted || cursor.failed()) {
+        return {};
+    }
+    std::string_view literal =
+        cursor.string.substr(start + 1, cursor.idx - start - 2);
+    if (literal.find('\\') == std::string_view::npos) {
+        return literal;
+    }
+    Cursor unescaper(cursor.string.substr(start), cursor.options);
+    return deserializeKey(unescaper, scratch);
+}
+
+template <typename Handler>
+void parseKey(Cursor &cursor, Handler &handler, std::string &scratch) {
+    cursor.skipWhitespaceAndComments();
+    std::string_view key = readString<
+        requires { handler.key(std::string_view()); }>(cursor, scratch);
+    if (cursor.failed()) {
+        return;
+    }
+    if constexpr (requires { handler.key(key); }) {
+        emit(cursor, [&] { return handler.key(key); });
+    }
+    cursor.skipWhitespaceAndComments();
+    cursor.expect(':');
+}
+
+template <typename Handler>
+void parseScalar(Cursor &cursor, Handler &handler, std::string &scratch) {
+    char c = cursor.peek();
+    if (c == '"') {
+        std::string_view string = readString<
+            requires { handler.string(std::string_view()); }>(cursor, scratch);
+        if constexpr (requires { handler.string(string); }) {
+            if (!cursor.failed()) {
+                emit(cursor, [&] { return handler.string(string); });
+            }
+        }
+    }
+    else if (c == '-' || isdigit((unsigned char)c)) {
+        const char *begin = cursor.c_str();
+        validateNumberLiteral(cursor);
+        std::string_view raw(begin, cursor.c_str() - begin);
+        if constexpr (requires { handler.number(raw); }) {
+            if (!cursor.failed()) {
+                emit(cursor, [&] { return handler.number(raw); });
+            }
+        }
+    }
+    else if (matchKeyword(cursor, "null")) {
+        if constexpr (requires { handler.null(); }) {
+            emit(cursor, [&] { return handler.null(); });
+        }
+    }
+    else if (matchKeyword(cursor, "true")) {
+        if constexpr (requires { handler.boolean(true); }) {
+            emit(cursor, [&] { return handler.boolean(true); });
+        }
+    }
+    else if (matchKeyword(cursor, "false")) {
+        if constexpr (requires { handler.boolean(false); }) {
+            emit(cursor, [&] { return handler.boolean(false); });
+        }
+    }
+    else {
+        validateKeyword(cursor);
+    }
+}
+
+template <typename Handler>
+void parse(Cursor &cursor, Handler &handler) {
+    std::string scratch;
+    // one bit per open container, set for objects
+    uint64_t objects[MAX_VALIDATE_DEPTH / 64];
+    int depth = 0;
+    auto close = [&](bool object) {
+        cursor.next();
+        depth--;
+        if (object) {
+            if constexpr (requires { handler.end_object(); }) {
+                emit(cursor, [&] { return handler.end_object(); });
+            }
+        }
+        else {
+            if constexpr (requires { handler.end_array(); }) {
+                emit(cursor, [&] { return handler.end_array(); });
+            }
+        }
+    };
+    while (!cursor.failed()) {
+        cursor.skipWhitespaceAndComments();
+        char c = cursor.peek();
+        if (c == '[' || c == '{') {
+            if (depth == MAX_VALIDATE_DEPTH) {
+                cursor.fail("nesting too deep");
+                return;
+            }
+            bool object = c == '{';
+            uint64_t bit = (uint64_t)1 << (depth % 64);
+            if (object) {
+                objects[depth / 64] |= bit;
+            }
+            else {
+                objects[depth / 64] &= ~bit;
+            }
+            depth++;
+            cursor.next();
+            if (object) {
+                if constexpr (requires { handler.start_object(); }) {
+                    emit(cursor, [&] { return handler.start_object(); });
+                }
+            }
+            else {
+                if constexpr (requires { handler.start_array(); }) {
+                    emit(cursor, [&] { return handler.start_array(); });
+                }
+            }
+            cursor.skipWhitespaceAndComments();
+            if (cursor.peek() != (object ? '}' : ']')) {
+                if (object) {
+                    parseKey(cursor, handler, scratch);
+                }
+                // continue with the first element
+                continue;
+            }
+            close(object);
+        }
+        else {
+            parseScalar(cursor, handler, scratch);
+        }
+        // a value is complete, so close every container it completes
+        while (depth && !cursor.failed()) {
+            bool object = objects[(depth - 1) / 64] >> ((depth - 1) % 64) & 1;
+            cursor.skipWhitespaceAndComments();
+            if (cursor.peek() == (object ? '}' : ']')) {
+                close(object);
+                continue;
+            }
+            cursor.expect(',');
+            if (object) {
+                parseKey(cursor, handler, scratch);
+            }
+            break;
+        }
+        if (!depth) {
+            return;
+        }
+    }
+}
+
+template <typename Handler>
+error parse(
+    std::string_view json, Handler &handler, const Options &options = Options()
+) {
+    Cursor cursor(json, options);
+    parse(cursor, handler);
+    if (!cursor.failed()) {
+        cursor.skipWhitespaceAndComments();
+        if (!cursor.eof()) {
+            cursor.fail("expected EOF");
+        }
+    }
+    return cursor.error;
+}
+
+};
+
+inline void validateAny(Cursor &cursor) {
+    struct {} ignore;
+    sax::parse(cursor, ignore);
+}
+// }}}
+// HASHING {{{
+// xxh64 by yann collet, fed incrementally. any class with the same
+// update() and digest() can stand in for it in json::hash().
+class XXHash64
+{
+    static constexpr uint64_t PRIME1 = 0x9e3779b185ebca87;
+    static constexpr uint64_t PRIME2 = 0xc2b2ae3d27d4eb4f;
+    static constexpr uint64_t PRIME3 = 0x165667b19e3779f9;
+    static constexpr uint64_t PRIME4 = 0x85ebca77c2b2ae63;
+    static constexpr uint64_t PRIME5 = 0x27d4eb2f165667c5;
+
+    uint64_t m_lanes[4];
+    uint64_t m_seed;
+    uint64_t m_length = 0;
+    // input short of a whole 32 byte stripe
+    unsigned char m_pending[32];
+    size_t m_pendingSize = 0;
+
+    static uint64_t rotate(uint64_t x, int bits) {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    static uint64_t read64(const unsigned char *p) {
+        uint64_t x;
+        memcpy(&x, p, 8);
+        return x;
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t input) {
+        return rotate(lane + input * PRIME2, 31) * PRIME1;
+    }
+
+    static uint64_t merge(uint64_t hash, uint64_t lane) {
+        return (hash ^ round(0, lane)) * PRIME1 + PRIME4;
+    }
+
+    void stripe(const unsigned char *p) {
+        for (int i = 0; i < 4; i++) {
+            m_lanes[i] = round(m_lanes[i], read64(p + 8 * i));
+        }
+    }
+
+public:
+    XXHash64(uint64_t seed = 0) : m_seed(seed) {
+        m_lanes[0] = seed + PRIME1 + PRIME2;
+        m_lanes[1] = seed + PRIME2;
+        m_lanes[2] = seed;
+        m_lanes[3] = seed - PRIME1;
+    }
+
+    void update(const char *data, size_t size) {
+        const unsigned char *p = (const unsigned char *)data;
+        const unsigned char *end = p + size;
+        m_length += size;
+        if (m_pendingSize + size < 32) {
+            memcpy(m_pending + m_pendingSize, p, size);
+            m_pendingSize += size;
+            return;
+        }
+        if (m_pendingSize) {
+            size_t fill = 32 - m_pendingSize;
+            memcpy(m_pending + m_pendingSize, p, fill);
+            stripe(m_pending);
+            p += fill;
+            m_pendingSize = 0;
+        }
+        for (; end - p >= 32; p += 32) {
+            stripe(p);
+        }
+        memcpy(m_pending, p, end - p);
+        m_pendingSize = end - p;
+    }
+
+    uint64_t digest() const {
+        uint64_t hash;
+        if (m_length >= 32) {
+            hash = rotate(m_lanes[0], 1) + rotate(m_lanes[1], 7)
+                + rotate(m_lanes[2], 12) + rotate(m_lanes[3], 18);
+            for (uint64_t lane : m_lanes) {
+                hash = merge(hash, lane);
+            }
+        }
+        else {
+            hash = m_seed + PRIME5;
+        }
+        hash += m_length;
+        const unsigned char *p = m_pending;
+        const unsigned char *end = p + m_pendingSize;
+        for (; end - p >= 8; p += 8) {
+            hash = rotate(hash ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+        }
+        if (end - p >= 4) {
+            uint32_t x;
+            memcpy(&x, p, 4);
+            hash = rotate(hash ^ (x * PRIME1), 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            hash = rotate(hash ^ (*p * PRIME5), 11) * PRIME1;
+        }
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+};
+
+// hashes the canonical serialization of `item` without materializing it.
+// the output passes through a buffer on the stack, so only sorting the
+// elements of unordered containers larger than 32 ever allocates.
+template <typename Hasher = XXHash64, typename T>
+auto hash(const T &item, Hasher hasher = Hasher()) {
+    auto sink = [&](const char *data, size_t size) {
+        hasher.update(data, size);
+    };
+    Options options;
+    options.canonical = true;
+    char buffer[4096];
+    Writer writer(sink, buffer, sizeof(buffer), options);
+    serialize(item, writer);
+    writer.flush();
+    return hasher.digest();
+}
+// }}}
+// JSON PRETTIFIER {{{
+// reformats arbitrary json text, fed in chunks of any size, into a Writer.
+// with the writer's indent option set it prettifies, otherwise it minifies.
+// comments are dropped. apart from the writer's fixed buffer, the only
+// state is the nesting depth and where the last chunk ended.
+class Reformatter
+{
+    enum State {
+        VALUE,
+        STRING,
+        STRING_ESCAPE,
+        SLASH,
+        LINE_COMMENT,
+        BLOCK_COMMENT,
+        BLOCK_COMMENT_STAR,
+    };
+
+    Writer &m_writer;
+    State m_state = VALUE;
+    // an opening bracket was written but whether its container is empty is
+    // only known from the next token
+    bool m_open = false;
+
+    static bool isDelimiter(char c) {
+        switch (c) {
+            case ' ': case '\t': case '\n': case '\r':
+            case '[': case ']': case '{': case '}':
+            case ',': case ':': case '"': case '/':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    const char *token(const char *p, const char *end) {
+        p = simd::skipWhitespace(p, end);
+        if (p == end) {
+            return p;
+        }
+        char c = *p;
+        if (c == '/') {
+            m_state = SLASH;
+            return p + 1;
+        }
+        if (m_open) {
+            m_open = false;
+            if (c == ']' || c == '}') {
+                m_writer.dedent();
+                m_writer.put(c);
+                return p + 1;
+            }
+            m_writer.newline();
+        }
+        switch (c) {
+            case '"':
+                m_writer.put(c);
+                m_state = STRING;
+                return p + 1;
+            case '[':
+            case '{':
+                m_writer.put(c);
+                m_writer.indent();
+                m_open = true;
+                return p + 1;
+            case ']':
+            case '}':
+                m_writer.dedent();
+                m_writer.newline();
+                m_writer.put(c);
+                return p + 1;
+            case ':':
+                m_writer.put(c);
+                if (m_writer.pretty()) {
+                    m_writer.put(' ');
+                }
+                return p + 1;
+            case ',':
+                m_writer.put(c);
+                m_writer.newline();
+                return p + 1;
+            default: {
+                const char *start = p;
+                while (p < end && !isDelimiter(*p)) {
+                    p++;
+                }
+                m_writer.write(start, p - start);
+                return p;
+            }
+        }
+    }
+
+public:
+    Reformatter(Writer &writer) : m_writer(writer) {}
+
+    void feed(std::string_view chunk) {
+        const char *p = chunk.data();
+        const char *end = p + chunk.size();
+        while (p < end) {
+            switch (m_state) {
+                case VALUE:
+                    p = token(p, end);
+                    break;
+                case STRING: {
+                    const char *invalid = nullptr;
+                    const char *stop = simd::scanString(p, end, 0, &invalid);
+                    m_writer.write(p, stop - p);
+                    p = stop;
+                    if (p < end) {
+                        m_state = *p == '"' ? VALUE : STRING_ESCAPE;
+                        m_writer.put(*p++);
+                    }
+                    break;
+                }
+                case STRING_ESCAPE:
+                    m_writer.put(*p++);
+                    m_state = STRING;
+                    break;
+                case SLASH:
+                    if (*p == '/' || *p == '*') {
+                        m_state = *p == '/' ? LINE_COMMENT : BLOCK_COMMENT;
+                        p++;
+                    }
+                    else {
+                        // not a comment, so not json either. pass it along.
+                        m_writer.put('/');
+                        m_state = VALUE;
+                    }
+                    break;
+                case LINE_COMMENT: {
+                    const char *nl = (const char *)memchr(p, '\n', end - p);
+                    p = nl ? nl + 1 : end;
+                    m_state = nl ? VALUE : LINE_COMMENT;
+                    break;
+                }
+                case BLOCK_COMMENT: {
+                    const char *star = (const char *)memchr(p, '*', end - p);
+                    p = star ? star + 1 : end;
+                    m_state = star ? BLOCK_COMMENT_STAR : BLOCK_COMMENT;
+                    break;
+                }
+                case BLOCK_COMMENT_STAR:
+                    if (*p == '/') {
+                        m_state = VALUE;
+                    }
+                    else if (*p != '*') {
+                        m_state = BLOCK_COMMENT;
+                    }
+                    p++;
+                    break;
+            }
+        }
+    }
+
+    void finish() {
+        if (m_state == SLASH) {
+            m_writer.put('/');
+            m_state = VALUE;
+        }
+        m_writer.flush();
+    }
+};
+
+inline std::string prettify(std::string_view json, int indent = 4) {
+    Options options;
+    options.indent = indent;
+    Writer writer(options);
+    Reformatter reformatter(writer);
+    reformatter.feed(json);
+    reformatter.finish();
+    return writer.take();
+}
+
+inline std::string minify(std::string_view json) {
+    Writer writer;
+    Reformatter reformatter(writer);
+    reformatter.feed(json);
+    reformatter.finish();
+    return writer.take();
+}
+
+class Prettifier
+{
+    int m_indent;
+
+public:
+    Prettifier() : m_indent(4) {}
+    Prettifier(int indent) : m_indent(indent) {}
+
+    void setIndent(int indent) {
+        m_indent = indent;
+    }
+
+    std::string prettify(std::string_view json) {
+        return json::prettify(json, m_indent);
+    }
+};
+// }}}
+// BINARY ENCODING {{{
+// helpers shared by the binary formats. input is read through a Cursor over
+// the raw bytes, so errors carry byte offsets just like json errors.
+namespace binary {
+
+inline std::string_view view(std::span<const uint8_t> data) {
+    return std::string_view((const char *)data.data(), data.size());
+}
+
+template <typename T>
+void writeBigEndian(char *out, T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out[i] = (char)(value >> (8 * (sizeof(T) - 1 - i)));
+    }
+}
+
+// writes the type byte `head` followed by `value` in network byte order
+template <typename T>
+void writeHead(Writer &writer, uint8_t head, T value) {
+    char *out = writer.reserve(1 + sizeof(T));
+    out[0] = (char)head;
+    writeBigEndian(out + 1, value);
+    writer.advance(out + 1 + sizeof(T));
+}
+
+inline bool readByte(Cursor &cursor, uint8_t &byte) {
+    if (cursor.eof()) {
+        cursor.fail("unexpected end of input");
+        return false;
+    }
+    byte = (uint8_t)cursor.string[cursor.idx++];
+    return true;
+}
+
+// views the next `size` bytes of the input
+inline bool readBytes(Cursor &cursor, size_t size, const char *&data) {
+    if (cursor.remaining() < size) {
+        cursor.fail("unexpected end of input");
+        return false;
+    }
+    data = cursor.c_str();
+    cursor.idx += size;
+    return true;
+}
+
+template <typename T>
+bool readBigEndian(Cursor &cursor, T &value) {
+    const char *data;
+    if (!readBytes(cursor, sizeof(T), data)) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        value = (T)(value << 8) | (uint8_t)data[i];
+    }
+    return true;
+}
+
+// whether `value` read from the input fits in T
+template <typename T, typename V>
+bool inRange(V value) {
+    if constexpr (std::is_signed<V>::value) {
+        if (value < 0) {
+            return std::is_signed<T>::value
+                && value >= (int64_t)std::numeric_limits<T>::min();
+        }
+    }
+    return (uint64_t)value <= (uint64_t)std::numeric_limits<T>::max();
+}
+
+// a length read from the input, limited to what the remaining bytes could
+// hold, for reserving space without trusting the input
+inline size_t reserveSize(Cursor &cursor, size_t size) {
+    return size < cursor.remaining() ? size : cursor.remaining();
+}
+
+inline void validateString(Cursor &cursor, const char *data, size_t size) {
+    if (cursor.options.validateUtf8) {
+        const char *invalid = utf8::validate(data, data + size);
+        if (invalid != data + size) {
+            cursor.fail(
+                "invalid utf-8 codepoint",
+                (int64_t)(invalid - cursor.string.data()));
+        }
+    }
+}
+
+inline void validateString(Writer &writer, const char *data, size_t size) {
+    if (writer.options.validateUtf8) {
+        const char *invalid = utf8::validate(data, data + size);
+        if (invalid != data + size) {
+            throwError({"invalid utf-8 codepoint", (int64_t)(invalid - data)});
+        }
+    }
+}
+
+// classes that are not reflected travel as a string holding the json of
+// their custom serializer
+template <typename T>
+void deserializeEmbedded(T &item, std::string_view json, Cursor &cursor) {
+    int64_t at = cursor.idx;
+    Cursor embedded(json, cursor.options);
+    catchErrors(embedded, [&] {
+        json::deserialize(item, embedded);
+    });
+    embedded.skipWhitespaceAndComments();
+    if (embedded.failed() || !embedded.eof()) {
+        cursor.fail("invalid embedded json", at);
+    }
+}
+
+template <typename T, typename F>
+error parse(T &item, std::string_view data, const Options &options, F &&f) {
+    Cursor cursor(data, options);
+    catchErrors(cursor, [&] {
+        f(item, cursor);
+    });
+    if (!cursor.failed() && !cursor.eof()) {
+        cursor.fail("expected EOF");
+    }
+    return cursor.error;
+}
+
+};
+// }}}
+// MESSAGEPACK {{{
+// the same types as json, encoded as MessagePack. reflected classes become
+// maps keyed by field name, containers become arrays (std::vector<uint8_t>
+// becomes bin) and std::map/std::unordered_map keep their native key type.
+namespace msgpack {
+
+template <typename T>
+void serialize(const T &item, Writer &writer);
+
+template <typename T>
+void deserialize(T &item, Cursor &cursor);
+
+inline void writeHeader(
+    Writer &writer, size_t size, uint8_t fix, size_t fixSize,
+    uint8_t head8, uint8_t head16, uint8_t head32
+) {
+    if (size < fixSize) {
+        writer.put((char)(fix | size));
+    }
+    else if (head8 && size <= 0xff) {
+        binary::writeHead(writer, head8, (uint8_t)size);
+    }
+    else if (size <= 0xffff) {
+        binary::writeHead(writer, head16, (uint16_t)size);
+    }
+    else {
+        binary::writeHead(writer, head32, (uint32_t)size);
+    }
+}
+
+inline void writeArrayHeader(Writer &writer, size_t size) {
+    writeHeader(writer, size, 0x90, 16, 0, 0xdc, 0xdd);
+}
+
+inline void writeMapHeader(Writer &writer, size_t size) {
+    writeHeader(writer, size, 0x80, 16, 0, 0xde, 0xdf);
+}
+
+inline void writeString(Writer &writer, const char *data, size_t size) {
+    binary::validateString(writer, data, size);
+    writeHeader(writer, size, 0xa0, 32, 0xd9, 0xda, 0xdb);
+    writer.write(data, size);
+}
+
+inline void writeBinary(Writer &writer, const uint8_t *data, size_t size) {
+    writeHeader(writer, size, 0, 0, 0xc4, 0xc5, 0xc6);
+    writer.write((const char *)data, size);
+}
+
+inline void writeNil(Writer &writer) {
+    writer.put((char)0xc0);
+}
+
+inline void writeBool(Writer &writer, bool value) {
+    writer.put((char)(value ? 0xc3 : 0xc2));
+}
+
+template <typename T>
+void writeInteger(Writer &writer, T value) {
+    if constexpr (std::is_signed<T>::value) {
+        if (value < 0) {
+            int64_t v = value;
+            if (v >= -32) {
+                writer.put((char)v);
+            }
+            else if (v >= INT8_MIN) {
+                binary::writeHead(writer, 0xd0, (uint8_t)v);
+            }
+            else if (v >= INT16_MIN) {
+                binary::writeHead(writer, 0xd1, (uint16_t)v);
+            }
+            else if (v >= INT32_MIN) {
+                binary::writeHead(writer, 0xd2, (uint32_t)v);
+            }
+            else {
+                binary::writeHead(writer, 0xd3, (uint64_t)v);
+            }
+            return;
+        }
+    }
+    uint64_t v = value;
+    if (v < 0x80) {
+        writer.put((char)v);
+    }
+    else if (v <= 0xff) {
+        binary::writeHead(writer, 0xcc, (uint8_t)v);
+    }
+    else if (v <= 0xffff) {
+        binary::writeHead(writer, 0xcd, (uint16_t)v);
+    }
+    else if (v <= 0xffffffff) {
+        binary::writeHead(writer, 0xce, (uint32_t)v);
+    }
+    else {
+        binary::writeHead(writer, 0xcf, v);
+    }
+}
+
+template <typename T>
+void writeFloat(Writer &writer, T value) {
+    if constexpr (std::is_same<T, float>().value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        binary::writeHead(writer, 0xca, bits);
+    }
+    else {
+        double d = value;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        binary::writeHead(writer, 0xcb, bits);
+    }
+}
+
+// the encoded key of field I of T
+template <typename T, size_t I>
+constexpr auto keyBytes() {
+    constexpr std::string_view key = std::get<I>(properties<T>()).key;
+    static_assert(key.size() <= 0xff, "field name too long");
+    constexpr size_t head = key.size() < 32 ? 1 : 2;
+    std::array<char, head + key.size()> bytes{};
+    if constexpr (head == 1) {
+        bytes[0] = (char)(0xa0 | key.size());
+    }
+    else {
+        bytes[0] = (char)0xd9;
+        bytes[1] = (char)key.size();
+    }
+    for (size_t i = 0; i < key.size(); i++) {
+        bytes[head + i] = key[i];
+    }
+    return bytes;
+}
+
+template <typename T>
+void serialize(const T &item, Writer &writer) {
+    if constexpr (is_specialization<T, std::unique_ptr>().value
+            || is_specialization<T, std::optional>().value) {
+        if (item) {
+            msgpack::serialize(*item, writer);
+        }
+        else {
+            writeNil(writer);
+        }
+    }
+    else if constexpr (is_specialization<T, std::pair>().value) {
+        writeArrayHeader(writer, 2);
+        msgpack::serialize(item.first, writer);
+        msgpack::serialize(item.second, writer);
+    }
+    else if constexpr (is_specialization<T, std::tuple>().value) {
+        constexpr auto size = std::tuple_size<T>::value;
+        writeArrayHeader(writer, size);
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            msgpack::serialize(std::get<i>(item), writer);
+        });
+    }
+    else if constexpr (std::is_same<T, std::vector<uint8_t>>().value
+            || std::is_same<T, bytes>().value) {
+        writeBinary(writer, item.data(), item.size());
+    }
+    else if constexpr (std::is_same<T, std::vector<bool>>().value) {
+        writeArrayHeader(writer, item.size());
+        for (bool elem : item) {
+            writeBool(writer, elem);
+        }
+    }
+    else if constexpr (is_specialization<T, std::vector>().value
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value) {
+        writeArrayHeader(writer, item.size());
+        for (const auto &elem : item) {
+            msgpack::serialize(elem, writer);
+        }
+    }
+    else if constexpr (is_specialization<T, std::queue>().value) {
+        writeArrayHeader(writer, item.size());
+        T copy = item;
+        while (copy.size()) {
+            msgpack::serialize(copy.front(), writer);
+            copy.pop();
+        }
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value) {
+        writeMapHeader(writer, item.size());
+        for (const auto &it : item) {
+            msgpack::serialize(it.first, writer);
+            msgpack::serialize(it.second, writer);
+        }
+    }
+    else if constexpr (std::is_same<T, std::string>().value) {
+        writeString(writer, item.data(), item.size());
+    }
+    else if constexpr (std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        if (item == nullptr) {
+            writeNil(writer);
+        }
+        else {
+            writeString(writer, item, strlen(item));
+        }
+    }
+    else if constexpr (std::is_array<T>().value) {
+        writeArrayHeader(writer, std::extent<T>::value);
+        for (const auto &elem : item) {
+            msgpack::serialize(elem, writer);
+        }
+    }
+    else if constexpr (std::is_same<T, bool>().value) {
+        writeBool(writer, item);
+    }
+    else if constexpr (std::is_pointer<T>().value) {
+        if (item == nullptr) {
+            writeNil(writer);
+        }
+        else {
+            msgpack::serialize(*item, writer);
+        }
+    }
+    else if constexpr (std::is_enum<T>().value) {
+        writeInteger(writer, (typename std::underlying_type<T>::type)item);
+    }
+    else if constexpr (std::is_same<T, char>().value) {
+        writeInteger(writer, (unsigned char)item);
+    }
+    else if constexpr (std::is_integral<T>().value) {
+        writeInteger(writer, item);
+    }
+    else if constexpr (std::is_floating_point<T>().value) {
+        writeFloat(writer, item);
+    }
+    else if constexpr (std::is_class<T>().value) {
+        if constexpr (isReflected<T>()) {
+            constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+            writeMapHeader(writer, fieldCount(item));
+            for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+                constexpr auto property = std::get<i>(properties<T>());
+                if (omitField<T, i>(item)) {
+                    return;
+                }
+                static constexpr auto key = keyBytes<T, i>();
+                writer.write(key.data(), key.size());
+                msgpack::serialize(item.*(property.value), writer);
+            });
+        }
+        else {
+            std::string json = json::serialize(item);
+            writeString(writer, json.data(), json.size());
+        }
+    }
+}
+
+template <typename T>
+std::string serialize(const T &item, const Options &options = Options()) {
+    Writer writer(options);
+    msgpack::serialize(item, writer);
+    return writer.take();
+}
+
+// consumes a nil if there is one
+inline bool readNil(Cursor &cursor) {
+    if (!cursor.eof() && (uint8_t)cursor.peek() == 0xc0) {
+        cursor.next();
+        return true;
+    }
+    return false;
+}
+
+inline bool readHeader(
+    Cursor &cursor, const char *expected, uint8_t fix, uint8_t fixMask,
+    uint8_t head8, uint8_t head16, uint8_t head32, size_t &size
+) {
+    int64_t at = cursor.idx;
+    uint8_t head;
+    if (!binary::readByte(cursor, head)) {
+        return false;
+    }
+    if (fixMask && (head & fixMask) == fix) {
+        size = head & ~fixMask;
+        return true;
+    }
+    if (head8 && head == head8) {
+        uint8_t value;
+        bool ok = binary::readBigEndian(cursor, value);
+        size = value;
+        return ok;
+    }
+    if (head == head16) {
+        uint16_t value;
+        bool ok = binary::readBigEndian(cursor, value);
+        size = value;
+        return ok;
+    }
+    if (head == head32) {
+        uint32_t value;
+        bool ok = binary::readBigEndian(cursor, value);
+        size = value;
+        return ok;
+    }
+    cursor.fail(std::string("expected ") + expected, at);
+    return false;
+}
+
+inline bool readArrayHeader(Cursor &cursor, size_t &size) {
+    return readHeader(cursor, "array", 0x90, 0xf0, 0, 0xdc, 0xdd, size);
+}
+
+inline bool readMapHeader(Cursor &cursor, size_t &size) {
+    return readHeader(cursor, "map", 0x80, 0xf0, 0, 0xde, 0xdf, size);
+}
+
+// reads an array header holding exactly `expected` elements
+inline bool readTupleHeader(Cursor &cursor, size_t expected) {
+    int64_t at = cursor.idx;
+    size_t size;
+    if (!readArrayHeader(cursor, size)) {
+        return false;
+    }
+    if (size != expected) {
+        cursor.fail(
+            "expected array of " + std::to_string(expected) + " elements", at);
+        return false;
+    }
+    return true;
+}
+
+// views a string in the input
+inline bool readString(Cursor &cursor, std::string_view &string) {
+    size_t size;
+    const char *data;
+    if (!readHeader(cursor, "string", 0xa0, 0xe0, 0xd9, 0xda, 0xdb, size)
+            || !binary::readBytes(cursor, size, data)) {
+        return false;
+    }
+    binary::validateString(cursor, data, size);
+    string = std::string_view(data, size);
+    return !cursor.failed();
+}
+
+inline bool readBool(Cursor &cursor, bool &value) {
+    int64_t at = cursor.idx;
+    uint8_t head;
+    if (!binary::readByte(cursor, head)) {
+        return false;
+    }
+    if (head != 0xc2 && head != 0xc3) {
+        cursor.fail("expected bool", at);
+        return false;
+    }
+    value = head == 0xc3;
+    return true;
+}
+
+template <typename U>
+bool readUnsigned(Cursor &cursor, uint64_t &value) {
+    U v;
+    bool ok = binary::readBigEndian(cursor, v);
+    value = v;
+    return ok;
+}
+
+template <typename S>
+bool readSigned(Cursor &cursor, int64_t &value) {
+    typename std::make_unsigned<S>::type v;
+    bool ok = binary::readBigEndian(cursor, v);
+    value = (S)v;
+    return ok;
+}
+
+template <typename T>
+void readInteger(Cursor &cursor, T &item) {
+    int64_t at = cursor.idx;
+    uint8_t head;
+    if (!binary::readByte(cursor, head)) {
+        return;
+    }
+    uint64_t u = 0;
+    int64_t s = 0;
+    bool isSigned = head >= 0xd0;
+    bool ok = true;
+    if (head <= 0x7f) {
+        u = head;
+    }
+    else if (head >= 0xe0) {
+        s = (int8_t)head;
+    }
+    else {
+        switch (head) {
+            case 0xcc: ok = readUnsigned<uint8_t>(cursor, u); break;
+            case 0xcd: ok = readUnsigned<uint16_t>(cursor, u); break;
+            case 0xce: ok = readUnsigned<uint32_t>(cursor, u); break;
+            case 0xcf: ok = readUnsigned<uint64_t>(cursor, u); break;
+            case 0xd0: ok = readSigned<int8_t>(cursor, s); break;
+            case 0xd1: ok = readSigned<int16_t>(cursor, s); break;
+            case 0xd2: ok = readSigned<int32_t>(cursor, s); break;
+            case 0xd3: ok = readSigned<int64_t>(cursor, s); break;
+            default:
+                cursor.fail("expected integer", at);
+                return;
+        }
+    }
+    if (!ok) {
+        return;
+    }
+    if (isSigned ? !binary::inRange<T>(s) : !binary::inRange<T>(u)) {
+        cursor.fail("integer out of range", at);
+        return;
+    }
+    item = isSigned ? (T)s : (T)u;
+}
+
+template <typename T>
+void readFloat(Cursor &cursor, T &item) {
+    uint8_t head = cursor.eof() ? 0xc1 : (uint8_t)cursor.peek();
+    if (head == 0xca) {
+        cursor.next();
+        uint32_t bits;
+        float value;
+        if (binary::readBigEndian(cursor, bits)) {
+            memcpy(&value, &bits, sizeof(value));
+            item = value;
+        }
+    }
+    else if (head == 0xcb) {
+        cursor.next();
+        uint64_t bits;
+        double value;
+        if (binary::readBigEndian(cursor, bits)) {
+            memcpy(&value, &bits, sizeof(value));
+            item = value;
+        }
+    }
+    else if ((head >= 0xd0 && head <= 0xd3) || head >= 0xe0) {
+        int64_t value;
+        readInteger(cursor, value);
+        item = value;
+    }
+    else {
+        uint64_t value;
+        readInteger(cursor, value);
+        item = value;
+    }
+}
+
+template <typename T>
+void deserializeFields(T &item, Cursor &cursor) {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    size_t count;
+    if (!readMapHeader(cursor, count)) {
+        return;
+    }
+    size_t n = 0;
+    SeenFields<T> seen{};
+    // fields written by our own serializer come in declaration order, so
+    // first match the encoded key of field i at position i
+    bool inOrder = true;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        if (n == count || !inOrder) {
+            return;
+        }
+        constexpr auto property = std::get<i>(properties<T>());
+        static constexpr auto key = keyBytes<T, i>();
+        if (cursor.remaining() < key.size()
+                || memcmp(cursor.c_str(), key.data(), key.size())) {
+            // an omittable field may just have been left out
+            inOrder = fieldPolicy<T, i>() != OMIT_NEVER;
+            return;
+        }
+        cursor.next(key.size());
+        markSeen<T, i>(seen);
+        msgpack::deserialize(item.*(property.value), cursor);
+        n++;
+    });
+    for (; n < count && !cursor.failed(); n++) {
+        int64_t keyIdx = cursor.idx;
+        std::string_view key;
+        if (!readString(cursor, key)) {
+            return;
+        }
+        uint32_t keyHash = fnv1a(key);
+        bool found = false;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            constexpr auto property = std::get<i>(properties<T>());
+            constexpr std::string_view name = property.key;
+            if (!found && keyHash == fnv1a(name) && key == name) {
+                found = true;
+                markSeen<T, i>(seen);
+                msgpack::deserialize(item.*(property.value), cursor);
+            }
+        });
+        if (!found) {
+            cursor.fail("unknown key '" + std::string(key) + "'", keyIdx);
+        }
+    }
+    resetOmittedFields(item, seen);
+}
+
+template <typename T>
+void deserialize(T &item, Cursor &cursor) {
+    if constexpr (is_specialization<T, std::unique_ptr>().value) {
+        if (readNil(cursor)) {
+            item.reset();
+        }
+        else {
+            item = std::make_unique<typename T::element_type>();
+            msgpack::deserialize(*item, cursor);
+        }
+    }
+    else if constexpr (is_specialization<T, std::optional>().value) {
+        if (readNil(cursor)) {
+            item.reset();
+        }
+        else {
+            typename T::value_type value{};
+            msgpack::deserialize(value, cursor);
+            item = std::move(value);
+        }
+    }
+    else if constexpr (is_specialization<T, std::pair>().value) {
+        if (readTupleHeader(cursor, 2)) {
+            msgpack::deserialize(item.first, cursor);
+            msgpack::deserialize(item.second, cursor);
+        }
+    }
+    else if constexpr (is_specialization<T, std::tuple>().value) {
+        constexpr auto size = std::tuple_size<T>::value;
+        if (readTupleHeader(cursor, size)) {
+            for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+                msgpack::deserialize(std::get<i>(item), cursor);
+            });
+        }
+    }
+    else if constexpr (std::is_same<T, bytes>().value) {
+        size_t size;
+        const char *data;
+        if (readHeader(cursor, "bin", 0, 0, 0xc4, 0xc5, 0xc6, size)
+                && binary::readBytes(cursor, size, data)) {
+            item.assign(data, data + size);
+        }
+    }
+    else if constexpr (std::is_same<T, std::vector<bool>>().value) {
+        size_t size;
+        if (!readArrayHeader(cursor, size)) {
+            return;
+        }
+        item.clear();
+        item.reserve(binary::reserveSize(cursor, size));
+        for (size_t i = 0; i < size && !cursor.failed(); i++) {
+            bool value = false;
+            readBool(cursor, value);
+            item.push_back(value);
+        }
+    }
+    else if constexpr (is_specialization<T, std::vector>().value
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::queue>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value) {
+        using Type = typename T::value_type;
+        if constexpr (std::is_same<T, std::vector<uint8_t>>().value) {
+            uint8_t head = cursor.eof() ? 0 : (uint8_t)cursor.peek();
+            if (head >= 0xc4 && head <= 0xc6) {
+                size_t size;
+                const char *data;
+                if (readHeader(cursor, "bin", 0, 0, 0xc4, 0xc5, 0xc6, size)
+                        && binary::readBytes(cursor, size, data)) {
+                    item.assign(data, data + size);
+                }
+                return;
+            }
+        }
+        size_t size;
+        if (!readArrayHeader(cursor, size)) {
+            return;
+        }
+        item = T();
+        if constexpr (is_specialization<T, std::vector>().value) {
+            item.reserve(binary::reserveSize(cursor, size));
+        }
+        for (size_t i = 0; i < size && !cursor.failed(); i++) {
+            Type elem{};
+            msgpack::deserialize(elem, cursor);
+            if constexpr (is_specialization<T, std::queue>().value) {
+                item.push(std::move(elem));
+            }
+            else if constexpr (is_specialization<T, std::set>().value
+                    || is_specialization<T, std::unordered_set>().value) {
+                item.insert(std::move(elem));
+            }
+            else {
+                item.push_back(std::move(elem));
+            }
+        }
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value) {
+        size_t size;
+        if (!readMapHeader(cursor, size)) {
+            return;
+        }
+        item = T();
+        for (size_t i = 0; i < size && !cursor.failed(); i++) {
+            typename T::key_type key{};
+            msgpack::deserialize(key, cursor);
+            msgpack::deserialize(item[std::move(key)], cursor);
+        }
+    }
+    else if constexpr (std::is_same<T, std::string>().value) {
+        std::string_view string;
+        if (readString(cursor, string)) {
+            item.assign(string.data(), string.size());
+        }
+    }
+    else if constexpr (std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        std::string_view string;
+        if (readNil(cursor)) {
+            item = nullptr;
+        }
+        else if (readString(cursor, string)) {
+            char *copy = new char[string.size() + 1];
+            memcpy(copy, string.data(), string.size());
+            copy[string.size()] = '\0';
+            item = copy;
+        }
+    }
+    else if constexpr (std::is_array<T>().value) {
+        int64_t at = cursor.idx;
+        size_t size;
+        if (!readArrayHeader(cursor, size)) {
+            return;
+        }
+        if (size > std::extent<T>::value) {
+            cursor.fail("too many elements in array", at);
+            return;
+        }
+        for (size_t i = 0; i < size; i++) {
+            msgpack::deserialize(item[i], cursor);
+        }
+    }
+    else if constexpr (std::is_same<T, bool>().value) {
+        readBool(cursor, item);
+    }
+    else if constexpr (std::is_pointer<T>().value) {
+        if (readNil(cursor)) {
+            item = nullptr;
+        }
+        else {
+            item = new typename std::remove_pointer<T>::type();
+            msgpack::deserialize(*item, cursor);
+        }
+    }
+    else if constexpr (std::is_enum<T>().value) {
+        typename std::underlying_type<T>::type value{};
+        readInteger(cursor, value);
+        item = (T)value;
+    }
+    else if constexpr (std::is_same<T, char>().value) {
+        unsigned char value = 0;
+        readInteger(cursor, value);
+        item = value;
+    }
+    else if constexpr (std::is_integral<T>().value) {
+        readInteger(cursor, item);
+    }
+    else if constexpr (std::is_floating_point<T>().value) {
+        readFloat(cursor, item);
+    }
+    else if constexpr (std::is_class<T>().value) {
+        if constexpr (isReflected<T>()) {
+            deserializeFields(item, cursor);
+        }
+        else {
+            std::string_view json;
+            if (readString(cursor, json)) {
+                binary::deserializeEmbedded(item, json, cursor);
+            }
+        }
+    }
+}
+
+template <typename T>
+error try_deserialize(
+    T &item, std::string_view data, const Options &options = Options()
+) {
+    return binary::parse(item, data, options, [](T &item, Cursor &cursor) {
+        msgpack::deserialize(item, cursor);
+    });
+}
+
+template <typename T>
+result<T> try_deserialize(
+    std::string_view data, const Options &options = Options()
+) {
+    result<T> res;
+    res.error = msgpack::try_deserialize(res.value, data, options);
+    return res;
+}
+
+template <typename T>
+result<T> try_deserialize(
+    std::span<const uint8_t> data, const Options &options = Options()
+) {
+    return msgpack::try_deserialize<T>(binary::view(data), options);
+}
+
+template <typename T>
+void deserialize(
+    T &item, std::string_view data, const Options &options = Options()
+) {
+    error err = msgpack::try_deserialize(item, data, options);
+    if (err) {
+        throwError(err);
+    }
+}
+
+template <typename T>
+T deserialize(std::string_view data, const Options &options = Options()) {
+    T item{};
+    msgpack::deserialize(item, data, options);
+    return item;
+}
+
+template <typename T>
+T deserialize(std::span<const uint8_t> data, const Options &options = Options()) {
+    return msgpack::deserialize<T>(binary::view(data), options);
+}
+
+};
+// }}}
+// CBOR {{{
+// the same types as json, encoded as CBOR (RFC 8949) with definite lengths.
+// reflected classes become maps keyed by field name, std::vector<uint8_t>
+// becomes a byte string and a std::span<const uint8_t> member views a byte
+// string in the input without copying it. the decoder also accepts tags
+// (which are skipped), half-precision floats and indefinite-length arrays
+// and maps.
+namespace cbor {
+
+enum Major {
+    UNSIGNED = 0,
+    NEGATIVE = 1,
+    BYTES = 2,
+    TEXT = 3,
+    ARRAY = 4,
+    MAP = 5,
+    TAG = 6,
+    SIMPLE = 7,
+};
+
+template <typename T>
+void serialize(const T &item, Writer &writer);
+
+template <typename T>
+void deserialize(T &item, Cursor &cursor);
+
+inline void writeHead(Writer &writer, Major major, uint64_t value) {
+    uint8_t type = major << 5;
+    if (value < 24) {
+        writer.put((char)(type | value));
+    }
+    else if (value <= 0xff) {
+        binary::writeHead(writer, type | 24, (uint8_t)value);
+    }
+    else if (value <= 0xffff) {
+        binary::writeHead(writer, type | 25, (uint16_t)value);
+    }
+    else if (value <= 0xffffffff) {
+        binary::writeHead(writer, type | 26, (uint32_t)value);
+    }
+    else {
+        binary::writeHead(writer, type | 27, value);
+    }
+}
+
+inline void writeText(Writer &writer, const char *data, size_t size) {
+    binary::validateString(writer, data, size);
+    writeHead(writer, TEXT, size);
+    writer.write(data, size);
+}
+
+inline void writeBytes(Writer &writer, const uint8_t *data, size_t size) {
+    writeHead(writer, BYTES, size);
+    writer.write((const char *)data, size);
+}
+
+inline void writeNull(Writer &writer) {
+    writer.put((char)0xf6);
+}
+
+inline void writeBool(Writer &writer, bool value) {
+    writer.put((char)(value ? 0xf5 : 0xf4));
+}
+
+template <typename T>
+void writeInteger(Writer &writer, T value) {
+    if constexpr (std::is_signed<T>::value) {
+        if (value < 0) {
+            writeHead(writer, NEGATIVE, ~(uint64_t)(int64_t)value);
+            return;
+        }
+    }
+    writeHead(writer, UNSIGNED, (uint64_t)value);
+}
+
+template <typename T>
+void writeFloat(Writer &writer, T value) {
+    if constexpr (std::is_same<T, float>().value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        binary::writeHead(writer, 0xfa, bits);
+    }
+    else {
+        double d = value;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        binary::writeHead(writer, 0xfb, bits);
+    }
+}
+
+// the encoded key of field I of T
+template <typename T, size_t I>
+constexpr auto keyBytes() {
+    constexpr std::string_view key = std::get<I>(properties<T>()).key;
+    static_assert(key.size() <= 0xff, "field name too long");
+    constexpr size_t head = key.size() < 24 ? 1 : 2;
+    std::array<char, head + key.size()> bytes{};
+    if constexpr (head == 1) {
+        bytes[0] = (char)(TEXT << 5 | key.size());
+    }
+    else {
+        bytes[0] = (char)(TEXT << 5 | 24);
+        bytes[1] = (char)key.size();
+    }
+    for (size_t i = 0; i < key.size(); i++) {
+        bytes[head + i] = key[i];
+    }
+    return bytes;
+}
+
+template <typename T>
+void serialize(const T &item, Writer &writer) {
+    if constexpr (is_specialization<T, std::unique_ptr>().value
+            || is_specialization<T, std::optional>().value) {
+        if (item) {
+            cbor::serialize(*item, writer);
+        }
+        else {
+            writeNull(writer);
+        }
+    }
+    else if constexpr (is_specialization<T, std::pair>().value) {
+        writeHead(writer, ARRAY, 2);
+        cbor::serialize(item.first, writer);
+        cbor::serialize(item.second, writer);
+    }
+    else if constexpr (is_specialization<T, std::tuple>().value) {
+        constexpr auto size = std::tuple_size<T>::value;
+        writeHead(writer, ARRAY, size);
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            cbor::serialize(std::get<i>(item), writer);
+        });
+    }
+    else if constexpr (std::is_same<T, std::vector<uint8_t>>().value
+            || std::is_same<T, std::span<const uint8_t>>().value
+            || std::is_same<T, bytes>().value) {
+        writeBytes(writer, item.data(), item.size());
+    }
+    else if constexpr (std::is_same<T, std::vector<bool>>().value) {
+        writeHead(writer, ARRAY, item.size());
+        for (bool elem : item) {
+            writeBool(writer, elem);
+        }
+    }
+    else if constexpr (is_specialization<T, std::vector>().value
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value) {
+        writeHead(writer, ARRAY, item.size());
+        for (const auto &elem : item) {
+            cbor::serialize(elem, writer);
+        }
+    }
+    else if constexpr (is_specialization<T, std::queue>().value) {
+        writeHead(writer, ARRAY, item.size());
+        T copy = item;
+        while (copy.size()) {
+            cbor::serialize(copy.front(), writer);
+            copy.pop();
+        }
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value) {
+        writeHead(writer, MAP, item.size());
+        for (const auto &it : item) {
+            cbor::serialize(it.first, writer);
+            cbor::serialize(it.second, writer);
+        }
+    }
+    else if constexpr (std::is_same<T, std::string>().value) {
+        writeText(writer, item.data(), item.size());
+    }
+    else if constexpr (std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        if (item == nullptr) {
+            writeNull(writer);
+        }
+        else {
+            writeText(writer, item, strlen(item));
+        }
+    }
+    else if constexpr (std::is_array<T>().value) {
+        writeHead(writer, ARRAY, std::extent<T>::value);
+        for (const auto &elem : item) {
+            cbor::serialize(elem, writer);
+        }
+    }
+    else if constexpr (std::is_same<T, bool>().value) {
+        writeBool(writer, item);
+    }
+    else if constexpr (std::is_pointer<T>().value) {
+        if (item == nullptr) {
+            writeNull(writer);
+        }
+        else {
+            cbor::serialize(*item, writer);
+        }
+    }
+    else if constexpr (std::is_enum<T>().value) {
+        writeInteger(writer, (typename std::underlying_type<T>::type)item);
+    }
+    else if constexpr (std::is_same<T, char>().value) {
+        writeInteger(writer, (unsigned char)item);
+    }
+    else if constexpr (std::is_integral<T>().value) {
+        writeInteger(writer, item);
+    }
+    else if constexpr (std::is_floating_point<T>().value) {
+        writeFloat(writer, item);
+    }
+    else if constexpr (std::is_class<T>().value) {
+        if constexpr (isReflected<T>()) {
+            constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+            writeHead(writer, MAP, fieldCount(item));
+            for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+                constexpr auto property = std::get<i>(properties<T>());
+                if (omitField<T, i>(item)) {
+                    return;
+                }
+                static constexpr auto key = keyBytes<T, i>();
+                writer.write(key.data(), key.size());
+                cbor::serialize(item.*(property.value), writer);
+            });
+        }
+        else {
+            std::string json = json::serialize(item);
+            writeText(writer, json.data(), json.size());
+        }
+    }
+}
+
+template <typename T>
+std::string serialize(const T &item, const Options &options = Options()) {
+    Writer writer(options);
+    cbor::serialize(item, writer);
+    return writer.take();
+}
+
+struct Head {
+    Major major;
+    // the low 5 bits of the initial byte. 31 marks an indefinite length.
+    uint8_t info;
+    uint64_t value;
+};
+
+// reads the initial byte and argument of the next data item, skipping tags
+inline bool readHead(Cursor &cursor, Head &head) {
+    while (true) {
+        int64_t at = cursor.idx;
+        uint8_t initial;
+        if (!binary::readByte(cursor, initial)) {
+            return false;
+        }
+        head.major = (Major)(initial >> 5);
+        head.info = initial & 0x1f;
+        head.value = head.info;
+        bool ok = true;
+        if (head.info == 24) {
+            uint8_t value;
+            ok = binary::readBigEndian(cursor, value);
+            head.value = value;
+        }
+        else if (head.info == 25) {
+            uint16_t value;
+            ok = binary::readBigEndian(cursor, value);
+            head.value = value;
+        }
+        else if (head.info == 26) {
+            uint32_t value;
+            ok = binary::readBigEndian(cursor, value);
+            head.value = value;
+        }
+        else if (head.info == 27) {
+            ok = binary::readBigEndian(cursor, head.value);
+        }
+        else if (head.info == 31) {
+            if (head.major < BYTES || head.major == TAG) {
+                cursor.fail("invalid indefinite length", at);
+                return false;
+            }
+            head.value = 0;
+        }
+        else if (head.info > 27) {
+            cursor.fail("invalid additional information", at);
+            return false;
+        }
+        if (!ok || head.major != TAG) {
+            return ok;
+        }
+    }
+}
+
+// consumes the "break" that ends an indefinite length item if there is one
+inline bool readBreak(Cursor &cursor) {
+    if (!cursor.eof() && (uint8_t)cursor.peek() == 0xff) {
+        cursor.next();
+        return true;
+    }
+    return false;
+}
+
+// consumes a null or undefined if there is one
+inline bool readNull(Cursor &cursor) {
+    uint8_t next = cursor.eof() ? 0 : (uint8_t)cursor.peek();
+    if (next == 0xf6 || next == 0xf7) {
+        cursor.next();
+        return true;
+    }
+    return false;
+}
+
+struct Length {
+    uint64_t size;
+    bool indefinite;
+};
+
+inline bool readLength(Cursor &cursor, Major major, Length &length) {
+    int64_t at = cursor.idx;
+    Head head;
+    if (!readHead(cursor, head)) {
+        return false;
+    }
+    if (head.major != major) {
+        cursor.fail(major == ARRAY ? "expected array" : "expected map", at);
+        return false;
+    }
+    length = {head.value, head.info == 31};
+    return true;
+}
+
+// whether element `i` of an array or map of `length` is present
+inline bool hasNext(Cursor &cursor, const Length &length, uint64_t i) {
+    if (cursor.failed()) {
+        return false;
+    }
+    return length.indefinite ? !readBreak(cursor) : i < length.size;
+}
+
+// reads an array holding exactly `expected` elements with `each`
+template <typename F>
+void readTuple(Cursor &cursor, size_t expected, F &&each) {
+    int64_t at = cursor.idx;
+    Length length;
+    if (!readLength(cursor, ARRAY, length)) {
+        return;
+    }
+    std::string error =
+        "expected array of " + std::to_string(expected) + " elements";
+    if (!length.indefinite && length.size != expected) {
+        cursor.fail(error, at);
+        return;
+    }
+    each();
+    if (length.indefinite && !cursor.failed() && !readBreak(cursor)) {
+        cursor.fail(error, at);
+    }
+}
+
+// views a definite length text or byte string in the input
+inline bool readString(Cursor &cursor, Major major, std::string_view &string) {
+    int64_t at = cursor.idx;
+    Head head;
+    if (!readHead(cursor, head)) {
+        return false;
+    }
+    if (head.major != major) {
+        cursor.fail(major == TEXT ? "expected text" : "expected bytes", at);
+        return false;
+    }
+    if (head.info == 31) {
+        cursor.fail("indefinite length strings are not supported", at);
+        return false;
+    }
+    const char *data;
+    if (!binary::readBytes(cursor, head.value, data)) {
+        return false;
+    }
+    if (major == TEXT) {
+        binary::validateString(cursor, data, head.value);
+    }
+    string = std::string_view(data, head.value);
+    return !cursor.failed();
+}
+
+inline bool readBool(Cursor &cursor, bool &value) {
+    int64_t at = cursor.idx;
+    Head head;
+    if (!readHead(cursor, head)) {
+        return false;
+    }
+    if (head.major != SIMPLE || (head.info != 20 && head.info != 21)) {
+        cursor.fail("expected bool", at);
+        return false;
+    }
+    value = head.info == 21;
+    return true;
+}
+
+// converts the argument of a NEGATIVE or UNSIGNED head, which must fit in T
+template <typename T>
+bool castInteger(Cursor &cursor, const Head &head, T &item, int64_t at) {
+    if (head.major == NEGATIVE) {
+        if (head.value > (uint64_t)INT64_MAX
+                || !binary::inRange<T>(-1 - (int64_t)head.value)) {
+            cursor.fail("integer out of range", at);
+            return false;
+        }
+        item = (T)(-1 - (int64_t)head.value);
+    }
+    else {
+        if (!binary::inRange<T>(head.value)) {
+            cursor.fail("integer out of range", at);
+            return false;
+        }
+        item = (T)head.value;
+    }
+    return true;
+}
+
+template <typename T>
+void readInteger(Cursor &cursor, T &item) {
+    int64_t at = cursor.idx;
+    Head head;
+    if (!readHead(cursor, head)) {
+        return;
+    }
+    if (head.major != UNSIGNED && head.major != NEGATIVE) {
+        cursor.fail("expected integer", at);
+        return;
+    }
+    castInteger(cursor, head, item, at);
+}
+
+inline double halfToDouble(uint16_t half) {
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0) {
+        value = std::ldexp(mantissa, -24);
+    }
+    else if (exponent != 31) {
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    }
+    else {
+        value = mantissa == 0 ? INFINITY : NAN;
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+template <typename T>
+void readFloat(Cursor &cursor, T &item) {
+    int64_t at = cursor.idx;
+    Head head;
+    if (!readHead(cursor, head)) {
+        return;
+    }
+    if (head.major == UNSIGNED || head.major == NEGATIVE) {
+        int64_t value;
+        if (head.major == UNSIGNED && head.value > (uint64_t)INT64_MAX) {
+            item = (T)head.value;
+        }
+        else if (castInteger(cursor, head, value, at)) {
+            item = (T)value;
+        }
+    }
+    else if (head.major == SIMPLE && head.info == 25) {
+        item = (T)halfToDouble((uint16_t)head.value);
+    }
+    else if (head.major == SIMPLE && head.info == 26) {
+        uint32_t bits = (uint32_t)head.value;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        item = (T)value;
+    }
+    else if (head.major == SIMPLE && head.info == 27) {
+        double value;
+        memcpy(&value, &head.value, sizeof(value));
+        item = (T)value;
+    }
+    else {
+        cursor.fail("expected number", at);
+    }
+}
+
+template <typename T>
+void deserializeFields(T &item, Cursor &cursor) {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    Length length;
+    if (!readLength(cursor, MAP, length)) {
+        return;
+    }
+    uint64_t n = 0;
+    SeenFields<T> seen{};
+    // fields written by our own serializer come in declaration order, so
+    // first match the encoded key of field i at position i
+    bool inOrder = !length.indefinite;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        if (n == length.size || !inOrder) {
+            return;
+        }
+        constexpr auto property = std::get<i>(properties<T>());
+        static constexpr auto key = keyBytes<T, i>();
+        if (cursor.remaining() < key.size()
+                || memcmp(cursor.c_str(), key.data(), key.size())) {
+            // an omittable field may just have been left out
+            inOrder = fieldPolicy<T, i>() != OMIT_NEVER;
+            return;
+        }
+        cursor.next(key.size());
+        markSeen<T, i>(seen);
+        cbor::deserialize(item.*(property.value), cursor);
+        n++;
+    });
+    for (; hasNext(cursor, length, n); n++) {
+        int64_t keyIdx = cursor.idx;
+        std::string_view key;
+        if (!readString(cursor, TEXT, key)) {
+            return;
+        }
+        uint32_t keyHash = fnv1a(key);
+        bool found = false;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            constexpr auto property = std::get<i>(properties<T>());
+            constexpr std::string_view name = property.key;
+            if (!found && keyHash == fnv1a(name) && key == name) {
+                found = true;
+                markSeen<T, i>(seen);
+                cbor::deserialize(item.*(property.value), cursor);
+            }
+        });
+        if (!found) {
+            cursor.fail("unknown key '" + std::string(key) + "'", keyIdx);
+        }
+    }
+    resetOmittedFields(item, seen);
+}
+
+template <typename T>
+void deserialize(T &item, Cursor &cursor) {
+    if constexpr (is_specialization<T, std::unique_ptr>().value) {
+        if (readNull(cursor)) {
+            item.reset();
+        }
+        else {
+            item = std::make_unique<typename T::element_type>();
+            cbor::deserialize(*item, cursor);
+        }
+    }
+    else if constexpr (is_specialization<T, std::optional>().value) {
+        if (readNull(cursor)) {
+            item.reset();
+        }
+        else {
+            typename T::value_type value{};
+            cbor::deserialize(value, cursor);
+            item = std::move(value);
+        }
+    }
+    else if constexpr (is_specialization<T, std::pair>().value) {
+        readTuple(cursor, 2, [&] {
+            cbor::deserialize(item.first, cursor);
+            cbor::deserialize(item.second, cursor);
+        });
+    }
+    else if constexpr (is_specialization<T, std::tuple>().value) {
+        constexpr auto size = std::tuple_size<T>::value;
+        readTuple(cursor, size, [&] {
+            for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+                cbor::deserialize(std::get<i>(item), cursor);
+            });
+        });
+    }
+    else if constexpr (std::is_same<T, std::span<const uint8_t>>().value) {
+        std::string_view bytes;
+        if (readString(cursor, BYTES, bytes)) {
+            item = T((const uint8_t *)bytes.data(), bytes.size());
+        }
+    }
+    else if constexpr (std::is_same<T, bytes>().value) {
+        std::string_view data;
+        if (readString(cursor, BYTES, data)) {
+            item.assign(data.begin(), data.end());
+        }
+    }
+    else if constexpr (std::is_same<T, std::vector<bool>>().value) {
+        Length length;
+        if (!readLength(cursor, ARRAY, length)) {
+            return;
+        }
+        item.clear();
+        item.reserve(binary::reserveSize(cursor, length.size));
+        for (uint64_t i = 0; hasNext(cursor, length, i); i++) {
+            bool value = false;
+            readBool(cursor, value);
+            item.push_back(value);
+        }
+    }
+    else if constexpr (is_specialization<T, std::vector>().value
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::queue>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value) {
+        using Type = typename T::value_type;
+        if constexpr (std::is_same<T, std::vector<uint8_t>>().value) {
+            uint8_t next = cursor.eof() ? 0 : (uint8_t)cursor.peek();
+            if (next >> 5 == BYTES) {
+                std::string_view bytes;
+                if (readString(cursor, BYTES, bytes)) {
+                    item.assign(bytes.begin(), bytes.end());
+                }
+                return;
+            }
+        }
+        Length length;
+        if (!readLength(cursor, ARRAY, length)) {
+            return;
+        }
+        item = T();
+        if constexpr (is_specialization<T, std::vector>().value) {
+            item.reserve(binary::reserveSize(cursor, length.size));
+        }
+        for (uint64_t i = 0; hasNext(cursor, length, i); i++) {
+            Type elem{};
+            cbor::deserialize(elem, cursor);
+            if constexpr (is_specialization<T, std::queue>().value) {
+                item.push(std::move(elem));
+            }
+            else if constexpr (is_specialization<T, std::set>().value
+                    || is_specialization<T, std::unordered_set>().value) {
+                item.insert(std::move(elem));
+            }
+            else {
+                item.push_back(std::move(elem));
+            }
+        }
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value) {
+        Length length;
+        if (!readLength(cursor, MAP, length)) {
+            return;
+        }
+        item = T();
+        for (uint64_t i = 0; hasNext(cursor, length, i); i++) {
+            typename T::key_type key{};
+            cbor::deserialize(key, cursor);
+            cbor::deserialize(item[std::move(key)], cursor);
+        }
+    }
+    else if constexpr (std::is_same<T, std::string>().value) {
+        std::string_view string;
+        if (readString(cursor, TEXT, string)) {
+            item.assign(string.data(), string.size());
+        }
+    }
+    else if constexpr (std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        std::string_view string;
+        if (readNull(cursor)) {
+            item = nullptr;
+        }
+        else if (readString(cursor, TEXT, string)) {
+            char *copy = new char[string.size() + 1];
+            memcpy(copy, string.data(), string.size());
+            copy[string.size()] = '\0';
+            item = copy;
+        }
+    }
+    else if constexpr (std::is_array<T>().value) {
+        int64_t at = cursor.idx;
+        Length length;
+        if (!readLength(cursor, ARRAY, length)) {
+            return;
+        }
+        uint64_t i = 0;
+        for (; hasNext(cursor, length, i); i++) {
+            if (i == std::extent<T>::value) {
+                cursor.fail("too many elements in array", at);
+                return;
+            }
+            cbor::deserialize(item[i], cursor);
+        }
+    }
+    else if constexpr (std::is_same<T, bool>().value) {
+        readBool(cursor, item);
+    }
+    else if constexpr (std::is_pointer<T>().value) {
+        if (readNull(cursor)) {
+            item = nullptr;
+        }
+        else {
+            item = new typename std::remove_pointer<T>::type();
+            cbor::deserialize(*item, cursor);
+        }
+    }
+    else if constexpr (std::is_enum<T>().value) {
+        typename std::underlying_type<T>::type value{};
+        readInteger(cursor, value);
+        item = (T)value;
+    }
+    else if constexpr (std::is_same<T, char>().value) {
+        unsigned char value = 0;
+        readInteger(cursor, value);
+        item = value;
+    }
+    else if constexpr (std::is_integral<T>().value) {
+        readInteger(cursor, item);
+    }
+    else if constexpr (std::is_floating_point<T>().value) {
+        readFloat(cursor, item);
+    }
+    else if constexpr (std::is_class<T>().value) {
+        if constexpr (isReflected<T>()) {
+            deserializeFields(item, cursor);
+        }
+        else {
+            std::string_view json;
+            if (readString(cursor, TEXT, json)) {
+                binary::deserializeEmbedded(item, json, cursor);
+            }
+        }
+    }
+}
+
+template <typename T>
+error try_deserialize(
+    T &item, std::string_view data, const Options &options = Options()
+) {
+    return binary::parse(item, data, options, [](T &item, Cursor &cursor) {
+        cbor::deserialize(item, cursor);
+    });
+}
+
+template <typename T>
+result<T> try_deserialize(
+    std::string_view data, const Options &options = Options()
+) {
+    result<T> res;
+    res.error = cbor::try_deserialize(res.value, data, options);
+    return res;
+}
+
+template <typename T>
+result<T> try_deserialize(
+    std::span<const uint8_t> data, const Options &options = Options()
+) {
+    return cbor::try_deserialize<T>(binary::view(data), options);
+}
+
+template <typename T>
+void deserialize(
+    T &item, std::string_view data, const Options &options = Options()
+) {
+    error err = cbor::try_deserialize(item, data, options);
+    if (err) {
+        throwError(err);
+    }
+}
+
+template <typename T>
+T deserialize(std::string_view data, const Options &options = Options()) {
+    T item{};
+    cbor::deserialize(item, data, options);
+    return item;
+}
+
+template <typename T>
+T deserialize(std::span<const uint8_t> data, const Options &options = Options()) {
+    return cbor::deserialize<T>(binary::view(data), options);
+}
+
+};
+// }}}
+// FILES {{{
+// a whole file mapped read-only into memory, or read into memory where mmap
+// is not available
+class MappedFile
+{
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+#if !JSON_MMAP
+    std::string m_contents;
+#endif
+
+public:
+    MappedFile() {}
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    // `sequential` tells the kernel the file will be read front to back,
+    // so it reads ahead and drops pages behind
+    error open(const char *path, bool sequential = false) {
+        close();
+        std::string failure = std::string("cannot open '") + path + "': ";
+#if JSON_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return {failure + strerror(errno), 0};
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            error err = {failure + strerror(errno), 0};
+            ::close(fd);
+            return err;
+        }
+        m_size = info.st_size;
+        if (m_size) {
+            void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                error err = {failure + strerror(errno), 0};
+                ::close(fd);
+                m_size = 0;
+                return err;
+            }
+            m_data = (const char *)data;
+            if (sequential) {
+                madvise(data, m_size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+#else
+        FILE *file = fopen(path, "rb");
+        if (!file) {
+            return {failure + strerror(errno), 0};
+        }
+        char buffer[1 << 16];
+        while (size_t n = fread(buffer, 1, sizeof(buffer), file)) {
+            m_contents.append(buffer, n);
+        }
+        fclose(file);
+        m_data = m_contents.data();
+        m_size = m_contents.size();
+        (void)sequential;
+#endif
+        return {};
+    }
+
+    void close() {
+#if JSON_MMAP
+        if (m_data) {
+            munmap((void *)m_data, m_size);
+        }
+#else
+        m_contents.clear();
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    std::string_view view() const {
+        return m_data ? std::string_view(m_data, m_size) : std::string_view();
+    }
+};
+
+// parses the json file at `path` straight out of its mapping, without
+// copying it into a string
+template <typename T>
+result<T> try_load_file(const char *path, const Options &options = Options()) {
+    result<T> res;
+    MappedFile file;
+    res.error = file.open(path, true);
+    if (!res.error) {
+        res.error = try_deserialize(res.value, file.view(), options);
+    }
+    return res;
+}
+
+template <typename T>
+T load_file(const char *path, const Options &options = Options()) {
+    result<T> res = try_load_file<T>(path, options);
+    if (res.error) {
+        throwError(res.error);
+    }
+    return std::move(res.value);
+}
+
+// a file written under a temporary name and renamed over `path` once it is
+// complete and on disk, so a failed save leaves any previous file intact.
+// until commit() succeeds the temporary file is removed on destruction.
+class OutputFile
+{
+    std::string m_path;
+    std::string m_temp;
+#if JSON_MMAP
+    int m_fd = -1;
+#else
+    FILE *m_file = nullptr;
+#endif
+    int m_err = 0;
+
+    bool isOpen() const {
+#if JSON_MMAP
+        return m_fd >= 0;
+#else
+        return m_file;
+#endif
+    }
+
+    // closes the file, keeping the first error
+    void close() {
+#if JSON_MMAP
+        if (m_fd >= 0 && ::close(m_fd) != 0 && !m_err) {
+            m_err = errno;
+        }
+        m_fd = -1;
+#else
+        if (m_file && fclose(m_file) != 0 && !m_err) {
+            m_err = errno ? errno : EIO;
+        }
+        m_file = nullptr;
+#endif
+    }
+
+    error failure() const {
+        return {"cannot write '" + m_path + "': " + strerror(m_err), 0};
+    }
+
+public:
+    OutputFile() {}
+
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+
+    ~OutputFile() {
+        if (isOpen()) {
+            close();
+            std::remove(m_temp.c_str());
+        }
+    }
+
+    error open(const char *path) {
+        m_path = path;
+        m_temp = m_path + ".tmp";
+        m_err = 0;
+#if JSON_MMAP
+        m_fd = ::open(m_temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (m_fd < 0) {
+            m_err = errno;
+        }
+#else
+        m_file = fopen(m_temp.c_str(), "wb");
+        if (!m_file) {
+            m_err = errno ? errno : EIO;
+        }
+#endif
+        return m_err ? failure() : error();
+    }
+
+    // errors are kept and reported by commit()
+    void write(const char *data, size_t size) {
+#if JSON_MMAP
+        while (size && !m_err) {
+            ssize_t n = ::write(m_fd, data, size);
+            if (n < 0) {
+                m_err = errno == EINTR ? 0 : errno;
+                continue;
+            }
+            data += n;
+            size -= n;
+        }
+#else
+        if (!m_err && fwrite(data, 1, size, m_file) != size) {
+            m_err = errno ? errno : EIO;
+        }
+#endif
+    }
+
+    // flushes the file to disk and renames it over `path`
+    error commit() {
+#if JSON_MMAP
+        if (!m_err && fsync(m_fd) != 0) {
+            m_err = errno;
+        }
+#endif
+        close();
+        if (!m_err && std::rename(m_temp.c_str(), m_path.c_str()) != 0) {
+            m_err = errno;
+        }
+        if (m_err) {
+            std::remove(m_temp.c_str());
+            return failure();
+        }
+        return {};
+    }
+};
+
+// writes `item` to the file at `path` through the 64 KiB buffer of a sink
+// Writer. the output goes to `path` + ".tmp", which is flushed to disk once
+// and then renamed over `path`.
+template <typename T>
+error save_file(
+    const char *path, const T &item, const Options &options = Options()
+) {
+    OutputFile file;
+    if (error err = file.open(path)) {
+        return err;
+    }
+    auto sink = [&](const char *data, size_t size) {
+        file.write(data, size);
+    };
+    Writer writer(sink, options);
+#if JSON_EXCEPTIONS
+    try {
+#endif
+        JSON_INSTRUMENT_BEGIN(SERIALIZE, T, true, 0);
+        serialize(item, writer);
+        writer.flush();
+        JSON_INSTRUMENT_END(writer.written());
+#if JSON_EXCEPTIONS
+    }
+    catch (const exception &ex) {
+        return {ex.description, ex.idx};
+    }
+#endif
+    return file.commit();
+}
+
+// reads the elements of one json array in a file one at a time, through a
+// buffer that is refilled as it is consumed, so memory use is bounded by
+// the largest element rather than the file:
+//
+//     json::array_reader<Row> reader;
+//     json::error err = reader.open("rows.json");
+//     for (Row &row : reader) { ... }
+//     err = reader.error();
+//
+// before an element is parsed, its extent is found by matching brackets
+// and quotes, and the buffer doubles while an element does not fit.
+template <typename T>
+class array_reader
+{
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    std::string m_buffer;
+    // over the unread part of the buffer, which it indexes from the start
+    Cursor m_cursor;
+    std::optional<JsonArrayParser> m_parser;
+    T m_item{};
+    json::error m_error;
+    // the offset in the file of the start of the buffer
+    uint64_t m_offset = 0;
+    bool m_started = false;
+    bool m_done = false;
+    bool m_eof = false;
+#if JSON_MMAP
+    int m_fd = -1;
+    bool m_owned = false;
+#else
+    FILE *m_file = nullptr;
+#endif
+
+    // the end of the whitespace and comments at `p`, or null if a comment
+    // runs past `end`
+    static const char *skipSpace(const char *p, const char *end) {
+        while (p < end) {
+            if (isspace(*p)) {
+                p++;
+            }
+            else if (*p != '/') {
+                return p;
+            }
+            else if (p + 1 == end) {
+                return nullptr;
+            }
+            else if (p[1] == '/') {
+                p = (const char *)memchr(p, '\n', end - p);
+                if (!p) {
+                    return nullptr;
+                }
+            }
+            else if (p[1] == '*') {
+                std::string_view rest(p + 2, end - p - 2);
+                size_t close = rest.find("*/");
+                if (close == std::string_view::npos) {
+                    return nullptr;
+                }
+                p += close + 4;
+            }
+            else {
+                return p;
+            }
+        }
+        return p;
+    }
+
+    // whether the buffer holds the next delimiter and the whole element
+    // after it. a value that reaches the end of the buffer may continue
+    // past it.
+    bool buffered() {
+        const char *end = m_cursor.string.data() + m_cursor.string.size();
+        const char *p = skipSpace(m_cursor.c_str(), end);
+        if (p && p < end && (*p == '[' || *p == ',')) {
+            p = skipSpace(p + 1, end);
+        }
+        if (!p || p == end) {
+            return false;
+        }
+        return *p == ']' || simd::skipValue(p, end) < end;
+    }
+
+    // moves the unread bytes to the front of the buffer and fills the rest
+    void refill() {
+        size_t used = m_cursor.idx;
+        size_t keep = m_cursor.string.size() - used;
+        memmove(m_buffer.data(), m_buffer.data() + used, keep);
+        m_offset += used;
+        if (keep == m_buffer.size()) {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+        size_t size = keep;
+        while (size < m_buffer.size() && !m_eof) {
+            char *data = m_buffer.data() + size;
+#if JSON_MMAP
+            long n = ::read(m_fd, data, m_buffer.size() - size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+#else
+            long n = fread(data, 1, m_buffer.size() - size, m_file);
+            n = !n && ferror(m_file) ? -1 : n;
+#endif
+            if (n < 0) {
+                m_eof = true;
+                m_cursor.fail(std::string("cannot read: ") + strerror(errno));
+                return;
+            }
+            m_eof = n == 0;
+            size += n;
+        }
+        m_cursor.string = std::string_view(m_buffer.data(), size);
+        m_cursor.idx = 0;
+    }
+
+    void fill() {
+        while (!m_eof && !m_cursor.failed() && !buffered()) {
+            refill();
+        }
+    }
+
+    void reset() {
+        close();
+        m_buffer.assign(BUFFER_SIZE, '\0');
+        m_cursor = Cursor(std::string_view(), m_cursor.options);
+        m_parser.emplace(m_cursor);
+        m_error = {};
+        m_offset = 0;
+        m_started = m_done = m_eof = false;
+    }
+
+public:
+    class iterator
+    {
+        array_reader *m_reader;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+
+        iterator(array_reader *reader = nullptr) : m_reader(reader) {}
+
+        T &operator*() const {
+            return m_reader->m_item;
+        }
+
+        T *operator->() const {
+            return &m_reader->m_item;
+        }
+
+        iterator &operator++() {
+            if (!m_reader->next(m_reader->m_item)) {
+                m_reader = nullptr;
+            }
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return m_reader == other.m_reader;
+        }
+    };
+
+    array_reader(const Options &options = Options())
+        : m_cursor(std::string_view(), options) {}
+
+    array_reader(const array_reader &) = delete;
+    array_reader &operator=(const array_reader &) = delete;
+
+    ~array_reader() {
+        close();
+    }
+
+    json::error open(const char *path) {
+        reset();
+        std::string failure = std::string("cannot open '") + path + "': ";
+#if JSON_MMAP
+        m_fd = ::open(path, O_RDONLY);
+        if (m_fd < 0) {
+            return {failure + strerror(errno), 0};
+        }
+        m_owned = true;
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+        m_file = fopen(path, "rb");
+        if (!m_file) {
+            return {failure + strerror(errno), 0};
+        }
+#endif
+        return {};
+    }
+
+#if JSON_MMAP
+    // reads from `fd`, which is left open
+    void open(int fd) {
+        reset();
+        m_fd = fd;
+    }
+#endif
+
+    void close() {
+#if JSON_MMAP
+        if (m_owned) {
+            ::close(m_fd);
+        }
+        m_fd = -1;
+        m_owned = false;
+#else
+        if (m_file) {
+            fclose(m_file);
+        }
+        m_file = nullptr;
+#endif
+    }
+
+    // replaces `item` with the next element. returns false after the last
+    // one, or on an error.
+    bool next(T &item) {
+        if (m_done) {
+            return false;
+        }
+        if (!m_parser) {
+            m_error = {"no file is open", 0};
+            m_done = true;
+            return false;
+        }
+        fill();
+        if (!m_started) {
+            m_started = true;
+            m_cursor.skipWhitespaceAndComments();
+            m_cursor.expect('[');
+        }
+        if (m_parser->optionalNext()) {
+            item = T{};
+            JSON_INSTRUMENT_BEGIN(DESERIALIZE, T, true, m_cursor.idx);
+            deserialize(item, m_cursor);
+            JSON_INSTRUMENT_END(m_cursor.idx);
+            if (!m_cursor.failed()) {
+                return true;
+            }
+        }
+        else if (!m_cursor.failed()) {
+            m_cursor.expect(']');
+            // only whitespace and comments may follow the array
+            while (!m_eof && !m_cursor.failed()) {
+                const char *end = m_cursor.string.data() + m_cursor.string.size();
+                const char *p = skipSpace(m_cursor.c_str(), end);
+                if (p && p < end) {
+                    break;
+                }
+                refill();
+            }
+            m_cursor.skipWhitespaceAndComments();
+            if (!m_cursor.eof()) {
+                m_cursor.fail("expected EOF");
+            }
+        }
+        m_done = true;
+        if (m_cursor.failed()) {
+            m_error = m_cursor.error;
+            m_error.idx += m_offset;
+        }
+        return false;
+    }
+
+    // the error that ended the elements early, if any
+    const json::error &error() const {
+        return m_error;
+    }
+
+    iterator begin() {
+        iterator it(this);
+        return ++it;
+    }
+
+    iterator end() {
+        return iterator();
+    }
+};
+// }}}
+// SNAPSHOT {{{
+// a binary layout that is read in place, typically straight out of a
+// mapped file. every value has a fixed size slot computed from its type:
+// scalars are stored inline, reflected classes, pairs, tuples and arrays
+// lay out their members inline one after another, strings, containers and
+// maps hold the offset and length of their out-of-line elements, and
+// optionals and pointers hold the offset of their value (0 if empty).
+// offsets are from the start of the snapshot and values are in the byte
+// order of the machine that wrote them.
+namespace snapshot {
+
+struct Header {
+    char magic[4];
+    uint32_t byteOrder;
+    uint64_t size;
+    uint64_t root;
+};
+
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+enum Kind {
+    SCALAR,
+    STRING,
+    SEQUENCE,
+    MAP,
+    OPTIONAL,
+    TUPLE,
+    ARRAY,
+    CLASS,
+    EMBEDDED,
+};
+
+template <typename T>
+constexpr Kind kindOf() {
+    if constexpr (is_specialization<T, std::unique_ptr>().value
+            || is_specialization<T, std::optional>().value) {
+        return OPTIONAL;
+    }
+    else if constexpr (is_specialization<T, std::pair>().value
+            || is_specialization<T, std::tuple>().value) {
+        return TUPLE;
+    }
+    else if constexpr (is_specialization<T, std::vector>().value
+            || is_specialization<T, std::list>().value
+            || is_specialization<T, std::deque>().value
+            || is_specialization<T, std::queue>().value
+            || is_specialization<T, std::set>().value
+            || is_specialization<T, std::unordered_set>().value) {
+        return SEQUENCE;
+    }
+    else if constexpr (is_specialization<T, std::map>().value
+            || is_specialization<T, std::unordered_map>().value) {
+        return MAP;
+    }
+    else if constexpr (std::is_same<T, std::string>().value
+            || std::is_same<T, char *>().value
+            || std::is_same<T, const char *>().value) {
+        return STRING;
+    }
+    else if constexpr (std::is_array<T>().value) {
+        return ARRAY;
+    }
+    else if constexpr (std::is_pointer<T>().value) {
+        return OPTIONAL;
+    }
+    else if constexpr (std::is_arithmetic<T>().value || std::is_enum<T>().value) {
+        return SCALAR;
+    }
+    else if constexpr (isReflected<T>()) {
+        return CLASS;
+    }
+    else {
+        // classes with a custom json serializer are stored as their json
+        return EMBEDDED;
+    }
+}
+
+struct Layout {
+    size_t size;
+    size_t align;
+};
+
+template <size_t N>
+struct Offsets {
+    std::array<size_t, N> field;
+    Layout layout;
+};
+
+constexpr size_t alignUp(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+template <typename T>
+constexpr Layout layout();
+
+// the offsets of members of the given types laid out one after another
+template <typename ...T>
+constexpr Offsets<sizeof...(T)> fieldOffsets() {
+    std::array<Layout, sizeof...(T)> layouts{layout<T>()...};
+    Offsets<sizeof...(T)> offsets{};
+    size_t size = 0;
+    size_t align = 1;
+    for (size_t i = 0; i < sizeof...(T); i++) {
+        size = alignUp(size, layouts[i].align);
+        offsets.field[i] = size;
+        size += layouts[i].size;
+        align = layouts[i].align > align ? layouts[i].align : align;
+    }
+    offsets.layout = {alignUp(size, align), align};
+    return offsets;
+}
+
+template <typename T, size_t I>
+using PropertyType = typename std::remove_cvref<
+    decltype(std::get<I>(properties<T>()))>::type::Type;
+
+template <typename T>
+struct Members;
+
+template <typename A, typename B>
+struct Members<std::pair<A, B>> {
+    static constexpr auto offsets = fieldOffsets<A, B>();
+};
+
+template <typename ...T>
+struct Members<std::tuple<T...>> {
+    static constexpr auto offsets = fieldOffsets<T...>();
+};
+
+template <typename T, size_t ...I>
+constexpr auto classOffsets(std::index_sequence<I...>) {
+    return fieldOffsets<PropertyType<T, I>...>();
+}
+
+template <typename T>
+    requires (isReflected<T>())
+struct Members<T> {
+    static constexpr auto offsets = classOffsets<T>(std::make_index_sequence<
+        std::tuple_size<decltype(properties<T>())>::value>{});
+};
+
+// the type a pointer, std::unique_ptr or std::optional holds
+template <typename T>
+using Pointee = typename std::remove_cvref<decltype(*std::declval<T>())>::type;
+
+template <typename T>
+constexpr Layout layout() {
+    constexpr Kind kind = kindOf<T>();
+    if constexpr (kind == SCALAR) {
+        return {sizeof(T), alignof(T)};
+    }
+    else if constexpr (kind == OPTIONAL) {
+        return {8, 8};
+    }
+    else if constexpr (kind == ARRAY) {
+        constexpr Layout element = layout<std::remove_extent_t<T>>();
+        return {element.size * std::extent<T>::value, element.align};
+    }
+    else if constexpr (kind == TUPLE || kind == CLASS) {
+        return Members<T>::offsets.layout;
+    }
+    else {
+        // an offset and a length
+        return {16, 8};
+    }
+}
+
+class Builder
+{
+    std::string m_buffer;
+
+public:
+    // returns the offset of `size` zeroed bytes aligned to `align`
+    size_t allocate(size_t size, size_t align) {
+        size_t at = alignUp(m_buffer.size(), align);
+        m_buffer.resize(at + size);
+        return at;
+    }
+
+    template <typename V>
+    void store(size_t at, const V &value) {
+        memcpy(&m_buffer[at], &value, sizeof(V));
+    }
+
+    void store(size_t at, const void *data, size_t size) {
+        if (size) {
+            memcpy(&m_buffer[at], data, size);
+        }
+    }
+
+    std::string take() {
+        return std::move(m_buffer);
+    }
+};
+
+template <typename T>
+void write(Builder &builder, size_t at, const T &item);
+
+inline void writeString(
+    Builder &builder, size_t at, const char *data, size_t size
+) {
+    // strings keep a terminator so views can hand out c strings
+    size_t offset = builder.allocate(size + 1, 1);
+    builder.store(offset, data, size);
+    builder.store(at, (uint64_t)offset);
+    builder.store(at + 8, (uint64_t)size);
+}
+
+template <typename T>
+void writeSequence(Builder &builder, size_t at, const T &item) {
+    using Type = typename T::value_type;
+    constexpr Layout element = layout<Type>();
+    size_t offset = builder.allocate(item.size() * element.size, element.align);
+    builder.store(at, (uint64_t)offset);
+    builder.store(at + 8, (uint64_t)item.size());
+    if constexpr (is_specialization<T, std::vector>().value
+            && kindOf<Type>() == SCALAR && !std::is_same<Type, bool>().value) {
+        builder.store(offset, item.data(), item.size() * sizeof(Type));
+    }
+    else if constexpr (is_specialization<T, std::queue>().value) {
+        T copy = item;
+        for (size_t i = 0; copy.size(); i++) {
+            write<Type>(builder, offset + i * element.size, copy.front());
+            copy.pop();
+        }
+    }
+    else {
+        size_t i = 0;
+        for (const auto &elem : item) {
+            write<Type>(builder, offset + i++ * element.size, elem);
+        }
+    }
+}
+
+template <typename T>
+void writeMap(Builder &builder, size_t at, const T &item) {
+    using Entry = std::pair<typename T::key_type, typename T::mapped_type>;
+    constexpr auto entry = Members<Entry>::offsets;
+    size_t offset = builder.allocate(
+        item.size() * entry.layout.size, entry.layout.align);
+    builder.store(at, (uint64_t)offset);
+    builder.store(at + 8, (uint64_t)item.size());
+    size_t i = 0;
+    for (const auto &it : item) {
+        size_t base = offset + i++ * entry.layout.size;
+        write(builder, base + entry.field[0], it.first);
+        write(builder, base + entry.field[1], it.second);
+    }
+}
+
+template <typename T>
+void write(Builder &builder, size_t at, const T &item) {
+    constexpr Kind kind = kindOf<T>();
+    if constexpr (kind == SCALAR) {
+        builder.store(at, item);
+    }
+    else if constexpr (kind == STRING) {
+        if constexpr (std::is_same<T, std::string>().value) {
+            writeString(builder, at, item.data(), item.size());
+        }
+        else if (item) {
+            writeString(builder, at, item, strlen(item));
+        }
+    }
+    else if constexpr (kind == SEQUENCE) {
+        writeSequence(builder, at, item);
+    }
+    else if constexpr (kind == MAP) {
+        writeMap(builder, at, item);
+    }
+    else if constexpr (kind == OPTIONAL) {
+        if (item) {
+            constexpr Layout value = layout<Pointee<T>>();
+            size_t offset = builder.allocate(value.size, value.align);
+            builder.store(at, (uint64_t)offset);
+            write(builder, offset, *item);
+        }
+    }
+    else if constexpr (kind == ARRAY) {
+        constexpr size_t stride = layout<std::remove_extent_t<T>>().size;
+        for (size_t i = 0; i < std::extent<T>::value; i++) {
+            write(builder, at + i * stride, item[i]);
+        }
+    }
+    else if constexpr (kind == TUPLE) {
+        constexpr auto offsets = Members<T>::offsets;
+        constexpr auto size = std::tuple_size<T>::value;
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            write(builder, at + offsets.field[i], std::get<i>(item));
+        });
+    }
+    else if constexpr (kind == CLASS) {
+        constexpr auto offsets = Members<T>::offsets;
+        constexpr auto size = offsets.field.size();
+        for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+            constexpr auto property = std::get<i>(properties<T>());
+            write(builder, at + offsets.field[i], item.*(property.value));
+        });
+    }
+    else {
+        std::string json = json::serialize(item);
+        writeString(builder, at, json.data(), json.size());
+    }
+}
+
+// lays out `item` in a single depth first pass
+template <typename T>
+std::string serialize(const T &item) {
+    constexpr Layout root = layout<T>();
+    Builder builder;
+    builder.allocate(sizeof(Header), alignof(Header));
+    size_t at = builder.allocate(root.size, root.align);
+    write(builder, at, item);
+    std::string data = builder.take();
+    Header header = {{'J', 'S', 'N', 'P'}, BYTE_ORDER_MARK, data.size(), at};
+    memcpy(data.data(), &header, sizeof(header));
+    return data;
+}
+
+template <typename T>
+error save(const T &item, const char *path) {
+    std::string data = serialize(item);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        std::string failure = std::string("cannot open '") + path + "': ";
+        return {failure + strerror(errno), 0};
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        return {std::string("cannot write '") + path + "'", 0};
+    }
+    return {};
+}
+
+template <typename T, Kind = kindOf<T>()>
+class View;
+
+// the common part of every view: where the snapshot starts and where the
+// slot of the viewed value is
+class Slot
+{
+protected:
+    const char *m_base = nullptr;
+    size_t m_at = 0;
+
+    template <typename V>
+    V load(size_t offset) const {
+        V value;
+        memcpy(&value, m_base + m_at + offset, sizeof(V));
+        return value;
+    }
+
+public:
+    Slot() {}
+    Slot(const char *base, size_t at) : m_base(base), m_at(at) {}
+};
+
+// iterates a run of `count` slots of type T
+template <typename T>
+class Iterator
+{
+    const char *m_base;
+    size_t m_at;
+    size_t m_index;
+
+public:
+    Iterator(const char *base, size_t at, size_t index)
+        : m_base(base), m_at(at), m_index(index) {}
+
+    View<T> operator*() const {
+        return View<T>(m_base, m_at + m_index * layout<T>().size);
+    }
+
+    Iterator &operator++() {
+        m_index++;
+        return *this;
+    }
+
+    bool operator==(const Iterator &other) const {
+        return m_index == other.m_index;
+    }
+};
+
+template <typename T>
+class View<T, SCALAR> : public Slot
+{
+public:
+    using Slot::Slot;
+
+    T get() const {
+        return load<T>(0);
+    }
+
+    operator T() const {
+        return get();
+    }
+};
+
+template <typename T>
+class View<T, STRING> : public Slot
+{
+public:
+    using Slot::Slot;
+
+    size_t size() const {
+        return load<uint64_t>(8);
+    }
+
+    const char *c_str() const {
+        uint64_t offset = load<uint64_t>(0);
+        return offset ? m_base + offset : "";
+    }
+
+    std::string_view get() const {
+        return std::string_view(c_str(), size());
+    }
+
+    operator std::string_view() const {
+        return get();
+    }
+
+    bool operator==(std::string_view other) const {
+        return get() == other;
+    }
+};
+
+template <typename T>
+class View<T, SEQUENCE> : public Slot
+{
+    using Type = typename T::value_type;
+
+public:
+    using Slot::Slot;
+
+    size_t size() const {
+        return load<uint64_t>(8);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    View<Type> operator[](size_t i) const {
+        return View<Type>(m_base, load<uint64_t>(0) + i * layout<Type>().size);
+    }
+
+    Iterator<Type> begin() const {
+        return Iterator<Type>(m_base, load<uint64_t>(0), 0);
+    }
+
+    Iterator<Type> end() const {
+        return Iterator<Type>(m_base, load<uint64_t>(0), size());
+    }
+
+    // the elements themselves, for containers of scalars
+    const Type *data() const requires (kindOf<Type>() == SCALAR) {
+        return (const Type *)(m_base + load<uint64_t>(0));
+    }
+};
+
+template <typename T>
+class View<T, MAP> : public Slot
+{
+    using Key = typename T::key_type;
+    using Value = typename T::mapped_type;
+    static constexpr auto entry =
+        Members<std::pair<Key, Value>>::offsets;
+
+    size_t entryAt(size_t i) const {
+        return load<uint64_t>(0) + i * entry.layout.size;
+    }
+
+public:
+    using Slot::Slot;
+
+    size_t size() const {
+        return load<uint64_t>(8);
+    }
+
+    View<Key> key(size_t i) const {
+        return View<Key>(m_base, entryAt(i) + entry.field[0]);
+    }
+
+    View<Value> value(size_t i) const {
+        return View<Value>(m_base, entryAt(i) + entry.field[1]);
+    }
+
+    // looks up a scalar or string key, by binary search for std::map
+    template <typename K>
+    std::optional<View<Value>> find(const K &key) const {
+        size_t lo = 0;
+        size_t hi = size();
+        if constexpr (is_specialization<T, std::map>().value) {
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (this->key(mid).get() < key) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            hi = size();
+        }
+        for (size_t i = lo; i < hi; i++) {
+            if (this->key(i).get() == key) {
+                return value(i);
+            }
+            if constexpr (is_specialization<T, std::map>().value) {
+                break;
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+template <typename T>
+class View<T, OPTIONAL> : public Slot
+{
+    using Type = Pointee<T>;
+
+public:
+    using Slot::Slot;
+
+    bool has_value() const {
+        return load<uint64_t>(0) != 0;
+    }
+
+    explicit operator bool() const {
+        return has_value();
+    }
+
+    View<Type> value() const {
+        return View<Type>(m_base, load<uint64_t>(0));
+    }
+
+    View<Type> operator*() const {
+        return value();
+    }
+};
+
+template <typename T>
+class View<T, ARRAY> : public Slot
+{
+    using Type = std::remove_extent_t<T>;
+
+public:
+    using Slot::Slot;
+
+    constexpr size_t size() const {
+        return std::extent<T>::value;
+    }
+
+    View<Type> operator[](size_t i) const {
+        return View<Type>(m_base, m_at + i * layout<Type>().size);
+    }
+
+    Iterator<Type> begin() const {
+        return Iterator<Type>(m_base, m_at, 0);
+    }
+
+    Iterator<Type> end() const {
+        return Iterator<Type>(m_base, m_at, size());
+    }
+};
+
+template <typename T>
+class View<T, TUPLE> : public Slot
+{
+public:
+    using Slot::Slot;
+
+    template <size_t I>
+    auto get() const {
+        using Type = typename std::tuple_element<I, T>::type;
+        return View<Type>(m_base, m_at + Members<T>::offsets.field[I]);
+    }
+};
+
+// the index of the reflected field `Member` of T
+template <typename T, auto Member>
+constexpr size_t fieldIndex() {
+    constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+    size_t index = size;
+    for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+        constexpr auto property = std::get<i>(properties<T>());
+        using Pointer = decltype(property.value);
+        if constexpr (std::is_same<Pointer, decltype(Member)>().value) {
+            if (property.value == Member) {
+                index = i;
+            }
+        }
+    });
+    return index;
+}
+
+template <typename T>
+class View<T, CLASS> : public Slot
+{
+public:
+    using Slot::Slot;
+
+    template <size_t I>
+    auto field() const {
+        return View<PropertyType<T, I>>(
+            m_base, m_at + Members<T>::offsets.field[I]);
+    }
+
+    // the view of a reflected field, as in `view.get<&Person::name>()`
+    template <auto Member>
+    auto get() const {
+        constexpr size_t index = fieldIndex<T, Member>();
+        static_assert(
+            index < std::tuple_size<decltype(properties<T>())>::value,
+            "not a reflected field");
+        return field<index>();
+    }
+};
+
+template <typename T>
+class View<T, EMBEDDED> : public Slot
+{
+public:
+    using Slot::Slot;
+
+    std::string_view json() const {
+        return View<std::string>(m_base, m_at).get();
+    }
+
+    T get() const {
+        return json::deserialize<T>(json());
+    }
+};
+
+// the root of a snapshot in O(1). run verify() first on untrusted data.
+template <typename T>
+View<T> view(std::string_view data) {
+    Header header;
+    memcpy(&header, data.data(), sizeof(header));
+    return View<T>(data.data(), header.root);
+}
+
+// bounds checks every offset and length in a snapshot. the writer
+// allocates out-of-line data in depth first order, so each offset must
+// come after all the data checked before it, which keeps verification
+// linear and rules out cycles.
+class Verifier
+{
+    std::string_view m_data;
+    size_t m_next = 0;
+    Options m_options;
+
+public:
+    json::error error;
+
+    Verifier(std::string_view data, const Options &options)
+        : m_data(data), m_options(options) {}
+
+    bool fail(std::string description, size_t at) {
+        if (!error) {
+            error = {std::move(description), (int64_t)at};
+        }
+        return false;
+    }
+
+    template <typename V>
+    V load(size_t at) const {
+        V value;
+        memcpy(&value, m_data.data() + at, sizeof(V));
+        return value;
+    }
+
+    // claims `count` slots of `size` bytes at the offset stored at `at`
+    bool claim(size_t at, uint64_t count, Layout layout) {
+        uint64_t offset = load<uint64_t>(at);
+        size_t available = m_data.size() - offset;
+        if (offset < m_next || offset > m_data.size()
+                || offset % layout.align != 0
+                || (layout.size && count > available / layout.size)) {
+            return fail("offset out of bounds", at);
+        }
+        m_next = offset + count * layout.size;
+        return true;
+    }
+
+    bool checkString(size_t at) {
+        uint64_t offset = load<uint64_t>(at);
+        uint64_t size = load<uint64_t>(at + 8);
+        if (offset == 0 && size == 0) {
+            return true;
+        }
+        if (size == UINT64_MAX || !claim(at, size + 1, {1, 1})) {
+            return fail("offset out of bounds", at);
+        }
+        const char *data = m_data.data() + offset;
+        if (data[size] != '\0') {
+            return fail("unterminated string", offset + size);
+        }
+        if (m_options.validateUtf8) {
+            const char *invalid = utf8::validate(data, data + size);
+            if (invalid != data + size) {
+                return fail("invalid utf-8 codepoint", invalid - m_data.data());
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool check(size_t at) {
+        constexpr Kind kind = kindOf<T>();
+        if constexpr (kind == SCALAR) {
+            if constexpr (std::is_same<T, bool>().value) {
+                if ((uint8_t)m_data[at] > 1) {
+                    return fail("invalid bool", at);
+                }
+            }
+            return true;
+        }
+        else if constexpr (kind == STRING || kind == EMBEDDED) {
+            return checkString(at);
+        }
+        else if constexpr (kind == SEQUENCE) {
+            using Type = typename T::value_type;
+            constexpr Layout element = layout<Type>();
+            uint64_t count = load<uint64_t>(at + 8);
+            if (!claim(at, count, element)) {
+                return false;
+            }
+            if (element.size == 0) {
+                return true;
+            }
+            uint64_t offset = load<uint64_t>(at);
+            for (uint64_t i = 0; i < count; i++) {
+                if (!check<Type>(offset + i * element.size)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        else if constexpr (kind == MAP) {
+            using Key = typename T::key_type;
+            using Value = typename T::mapped_type;
+            constexpr auto entry = Members<std::pair<Key, Value>>::offsets;
+            uint64_t count = load<uint64_t>(at + 8);
+            if (!claim(at, count, entry.layout)) {
+                return false;
+            }
+            uint64_t offset = load<uint64_t>(at);
+            for (uint64_t i = 0; i < count; i++) {
+                size_t base = offset + i * entry.layout.size;
+                if (!check<Key>(base + entry.field[0])
+                        || !check<Value>(base + entry.field[1])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        else if constexpr (kind == OPTIONAL) {
+            if (load<uint64_t>(at) == 0) {
+                return true;
+            }
+            return claim(at, 1, layout<Pointee<T>>())
+                && check<Pointee<T>>(load<uint64_t>(at));
+        }
+        else if constexpr (kind == ARRAY) {
+            using Type = std::remove_extent_t<T>;
+            for (size_t i = 0; i < std::extent<T>::value; i++) {
+                if (!check<Type>(at + i * layout<Type>().size)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        else if constexpr (kind == TUPLE) {
+            constexpr auto size = std::tuple_size<T>::value;
+            bool ok = true;
+            for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+                using Type = typename std::tuple_element<i, T>::type;
+                ok = ok && check<Type>(at + Members<T>::offsets.field[i]);
+            });
+            return ok;
+        }
+        else {
+            constexpr auto size = std::tuple_size<decltype(properties<T>())>::value;
+            bool ok = true;
+            for_sequence(std::make_index_sequence<size>{}, [&](auto i) {
+                using Type = PropertyType<T, i>;
+                ok = ok && check<Type>(at + Members<T>::offsets.field[i]);
+            });
+            return ok;
+        }
+    }
+
+    template <typename T>
+    bool checkRoot() {
+        constexpr Layout root = layout<T>();
+        Header header;
+        if (m_data.size() < sizeof(header)) {
+            return fail("invalid snapshot header", 0);
+        }
+        memcpy(&header, m_data.data(), sizeof(header));
+        if (memcmp(header.magic, "JSNP", 4) != 0
+                || header.byteOrder != BYTE_ORDER_MARK) {
+            return fail("invalid snapshot header", 0);
+        }
+        if (header.size != m_data.size()) {
+            return fail("snapshot size mismatch", 8);
+        }
+        if ((uintptr_t)m_data.data() % alignof(std::max_align_t) != 0) {
+            return fail("misaligned snapshot", 0);
+        }
+        m_next = sizeof(header);
+        if (!claim(offsetof(Header, root), 1, root)) {
+            return false;
+        }
+        return check<T>(header.root);
+    }
+};
+
+template <typename T>
+error verify(std::string_view data, const Options &options = Options()) {
+    Verifier verifier(data, options);
+    verifier.checkRoot<T>();
+    return verifier.error;
+}
+
+// a snapshot file mapped into memory
+template <typename T>
+class Mapping
+{
+    MappedFile m_file;
+
+public:
+    // maps the file at `path`, verifying it unless `trusted`
+    error open(const char *path, bool trusted = false) {
+        error err = m_file.open(path);
+        if (!err && !trusted) {
+            err = verify<T>(m_file.view());
+        }
+        if (err) {
+            m_file.close();
+        }
+        return err;
+    }
+
+    View<T> root() const {
+        return view<T>(m_file.view());
+    }
+};
+
 };
 // }}}
 };
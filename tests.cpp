@@ -4,11 +4,16 @@
 #include <string>
 
 #define JSON_ENCODE_ASCII
+#define JSON_VALIDATE_UTF8
+#define JSON_INSTRUMENT
 
 #include "json.hpp"
 
 json::Prettifier prettifier(4);
 
+// tests hold operations to an allocation budget
+#include "allocations.hpp"
+
 struct EmptyStruct {
     bool operator==(const EmptyStruct &rhs) {
         return true;
@@ -42,6 +47,29 @@ void json::deserialize(Keyword& s, Cursor &cursor) {
     }
 }
 
+// specializations apply to members and elements as well
+enum Color { RED, GREEN };
+
+template<>
+std::string json::serialize(const Color& color) {
+    return color == GREEN ? "\"green\"" : "\"red\"";
+}
+
+template<>
+void json::deserialize(Color& color, Cursor &cursor) {
+    std::string name;
+    json::deserialize(name, cursor);
+    color = name == "green" ? GREEN : RED;
+}
+
+struct Palette {
+    Color color;
+    std::vector<Color> colors;
+
+    bool operator==(const Palette &) const = default;
+};
+REFLECT(Palette, color, colors);
+
 struct MassiveStruct {
     std::string string1;
     std::string string2;
@@ -240,6 +268,15 @@ void test(std::string desc, T item, std::string expected) {
     }
 
     std::string prettyJson = prettifier.prettify(serialized);
+    json::Options prettyOptions;
+    prettyOptions.indent = 4;
+    std::string prettySerialized = json::serialize(item, prettyOptions);
+    if (prettySerialized != prettyJson) {
+        printf("PRETTY SERIALIZE FAIL\n");
+        printf("    %-15s %s\n", "expected", prettyJson.c_str());
+        printf("    %-15s %s\n", "serialized", prettySerialized.c_str());
+        return;
+    }
     try {
         deserialized = json::deserialize<T>(prettyJson);
     }
@@ -259,6 +296,26 @@ void test(std::string desc, T item, std::string expected) {
         }
     }
 
+    std::string msgpack = json::msgpack::serialize(item);
+    T unpacked{};
+    json::error err = json::msgpack::try_deserialize(unpacked, msgpack);
+    if (err || json::serialize(unpacked) != expected) {
+        printf("MSGPACK FAIL\n");
+        printf("    %-15s %s\n", "json", expected.c_str());
+        printf("    %-15s %s\n", "desc", err.description.c_str());
+        return;
+    }
+
+    std::string cbor = json::cbor::serialize(item);
+    T decoded{};
+    err = json::cbor::try_deserialize(decoded, cbor);
+    if (err || json::serialize(decoded) != expected) {
+        printf("CBOR FAIL\n");
+        printf("    %-15s %s\n", "json", expected.c_str());
+        printf("    %-15s %s\n", "desc", err.description.c_str());
+        return;
+    }
+
     printf("PASS\n");
 }
 
@@ -570,27 +627,83 @@ void mapTest() {
     );
 }
 
-void structTest() {
-    EmptyStruct emptyStruct;
-    test("empty struct", emptyStruct, "{}");
+void flatTest() {
+    test(
+        "flat map",
+        json::flat_map<std::string, int>{{"foo", 1}, {"bar", 2}},
+        "{\"bar\":2,\"foo\":1}"
+    );
+    test(
+        "flat set",
+        json::flat_set<int>{3, 1, 2, 1},
+        "[1,2,3]"
+    );
+
+    printf("%-20s", "flat unsorted");
+    auto map = json::deserialize<json::flat_map<int, std::vector<int>>>(
+        "{\"3\":[1],\"1\":[2],\"3\":[3,4],\"2\":[]}");
+    auto reversed = json::deserialize<
+        json::flat_map<std::string, int, std::greater<std::string>>>(
+        "{\"a\":1,\"c\":3,\"b\":2}");
+    if (json::serialize(map) != "{\"1\":[2],\"2\":[],\"3\":[3,4]}"
+            || map.at(3).size() != 2 || map.find(4) != map.end()
+            || json::serialize(reversed) != "{\"c\":3,\"b\":2,\"a\":1}") {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "map", json::serialize(map).c_str());
+        return;
+    }
+    printf("PASS\n");
+}
 
-    RealisticStruct realisticStruct {
+void mapKeysTest() {
+    printf("%-20s", "map keys");
+    // unsorted input, a repeated key and stale contents to replace
+    std::map<int, std::vector<int>> ints{{9, {9}}};
+    json::deserialize(ints, "{\"3\":[3],\"-1\":[1],\"3\":[4,5]}");
+    std::unordered_map<unsigned char, int> chars = json::deserialize<
+        std::unordered_map<unsigned char, int>>("{\"255\":1,\"0\":2}");
+    std::unordered_set<std::string> strings = json::deserialize<
+        std::unordered_set<std::string>>("[\"a\",\"b,]\\\"\",\"a\"]");
+    if (ints != std::map<int, std::vector<int>>{{-1, {1}}, {3, {4, 5}}}
+            || chars.size() != 2 || chars[255] != 1 || chars[0] != 2
+            || strings.size() != 2 || !strings.count("b,]\"")) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "ints", json::serialize(ints).c_str());
+        return;
+    }
+    const std::pair<std::string, json::error> cases[] = {
+        {"{\"1x\":0}", {"invalid key", 1}},
+        {"{\"\":0}", {"invalid key", 1}},
+        {"{\"99999999999\":0}", {"invalid key", 1}},
+        {"{1:0}", {"expected '\"' but got '1'", 2}},
+    };
+    for (const auto &[json, expected] : cases) {
+        json::result<std::map<int, int>> res =
+            json::try_deserialize<std::map<int, int>>(json);
+        if (res.error.description != expected.description
+                || res.error.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", json.c_str());
+            printf("    %-15s %s\n", "desc", res.error.description.c_str());
+            return;
+        }
+    }
+    printf("PASS\n");
+}
+
+RealisticStruct exampleRealisticStruct() {
+    return {
         "foo",
         100000,
         1.2345,
         1234.5,
         { 1, 2, 3, 4, 5, 6, 7, 8, 9 }
     };
-    test(
-        "realistic struct", realisticStruct,
-        "{\"string\":\"foo\",\"integer\":100000,\"float1\":1.234500,"
-        "\"float2\":1234.500000,\"integers\":[1,2,3,4,5,6,7,8,9]}"
-    );
-    
-    Keyword keyword { "test" };
-    test("custom funcs", keyword, "test");
+}
 
-    MassiveStruct massiveStruct {
+MassiveStruct exampleMassiveStruct() {
+    RealisticStruct realisticStruct = exampleRealisticStruct();
+    return {
         "foo", "bar", "baz", 1, 2, 3, 0.5, 1.5, 2.5, 10000, 20000, 30000, {},
         {
             {"foo", 100, 1.345, -134.5, {1, 6, 7, 8, 9}},
@@ -623,6 +736,72 @@ void structTest() {
         {"foo bar baz", "baz bar foo"},
         {"foo bar baz", {{"baz bar foo", "foo bar baz"}}},
     };
+}
+
+void bytesTest() {
+    test("bytes empty", json::bytes(), "\"\"");
+    test("bytes padded", json::bytes{'f', 'o', 'o', 'b'}, "\"Zm9vYg==\"");
+    json::bytes all(256);
+    for (int i = 0; i < 256; i++) {
+        all[i] = i;
+    }
+    std::string encoded;
+    for (int i = 0; i < 256; i += 3) {
+        const char *alphabet = json::base64::ALPHABET;
+        uint32_t n = all[i] << 16 | (i + 1 < 256 ? all[i + 1] << 8 : 0)
+            | (i + 2 < 256 ? all[i + 2] : 0);
+        encoded += alphabet[n >> 18];
+        encoded += alphabet[n >> 12 & 63];
+        encoded += i + 1 < 256 ? alphabet[n >> 6 & 63] : '=';
+        encoded += i + 2 < 256 ? alphabet[n & 63] : '=';
+    }
+    test("bytes all", all, "\"" + encoded + "\"");
+
+    printf("%-20s", "bytes decoding");
+    json::bytes slash = json::deserialize<json::bytes>("\"\\/w\"");
+    json::bytes unpadded = json::deserialize<json::bytes>("\"Zm9vYg\"");
+    if (slash != json::bytes{0xff} || unpadded != json::bytes{'f', 'o', 'o', 'b'}) {
+        printf("FAIL\n");
+        return;
+    }
+    const std::pair<std::string, json::error> cases[] = {
+        {"\"Zm9vY\"", {"invalid base64 length", 1}},
+        {"\"Zm9v.mFy\"", {"invalid base64 character", 5}},
+        {"\"" + encoded.substr(0, 40) + "*" + encoded.substr(41) + "\"",
+            {"invalid base64 character", 41}},
+        {"\"Zm9v", {"unterminated string", 1}},
+    };
+    for (const auto &[json, expected] : cases) {
+        json::result<json::bytes> res = json::try_deserialize<json::bytes>(json);
+        if (res.error.description != expected.description
+                || res.error.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", json.c_str());
+            printf("    %-15s %s\n", "desc", res.error.description.c_str());
+            return;
+        }
+    }
+    printf("PASS\n");
+}
+
+void structTest() {
+    EmptyStruct emptyStruct;
+    test("empty struct", emptyStruct, "{}");
+
+    RealisticStruct realisticStruct = exampleRealisticStruct();
+    test(
+        "realistic struct", realisticStruct,
+        "{\"string\":\"foo\",\"integer\":100000,\"float1\":1.234500,"
+        "\"float2\":1234.500000,\"integers\":[1,2,3,4,5,6,7,8,9]}"
+    );
+    
+    Keyword keyword { "test" };
+    test("custom funcs", keyword, "test");
+
+    Palette palette { GREEN, { RED, GREEN } };
+    test("nested custom", palette, "{\"color\":\"green\",\"colors\":[\"red\",\"green\"]}");
+
+    MassiveStruct massiveStruct = exampleMassiveStruct();
     test(
         "massive struct", massiveStruct,
         "{\"string1\":\"foo\",\"string2\":\"bar\",\"string3\":\"baz\",\"int1\":"
@@ -657,6 +836,160 @@ void structTest() {
     );
 };
 
+struct Event {
+    int id;
+    std::optional<std::string> name;
+    std::vector<int> tags;
+    std::unique_ptr<Event> parent;
+    double score;
+    std::map<std::string, int> counts;
+};
+REFLECT(Event, id, name, tags, parent, score, counts);
+REFLECT_OMIT(Event, json::OMIT_NULL | json::OMIT_EMPTY);
+REFLECT_OMIT_FIELDS(Event, json::OMIT_DEFAULT, score);
+REFLECT_OMIT_FIELDS(Event, json::OMIT_NEVER, id, tags);
+
+void omitTest() {
+    printf("%-20s", "omit policies");
+    Event event{};
+    std::string sparse = json::serialize(event);
+    event.name = "child";
+    event.parent = std::make_unique<Event>();
+    event.parent->score = 0.5;
+    event.counts["a"] = 1;
+    std::string full = json::serialize(event);
+    Event parsed = json::deserialize<Event>(full);
+    Event binary = json::msgpack::deserialize<Event>(
+        json::msgpack::serialize(event));
+    // a reused object loses the fields its input leaves out
+    auto stale = [] {
+        Event stale{9, "stale", {1, 2}, std::make_unique<Event>(), 3.5, {{"b", 2}}};
+        return stale;
+    };
+    auto reset = [](const Event &event) {
+        return event.id == 1 && !event.name && event.tags.empty()
+            && !event.parent && event.score == 0 && event.counts.empty();
+    };
+    Event reused = stale();
+    json::deserialize(reused, "{\"id\":1,\"tags\":[]}");
+    Event fromMsgpack = stale();
+    Event fromCbor = stale();
+    Event one{};
+    one.id = 1;
+    json::msgpack::deserialize(fromMsgpack, json::msgpack::serialize(one));
+    json::cbor::deserialize(fromCbor, json::cbor::serialize(one));
+    // elements start value-initialized, even without their fields
+    std::queue<Event> queue =
+        json::deserialize<std::queue<Event>>("[{\"tags\":[1]}]");
+    if (!reset(reused) || !reset(fromMsgpack) || !reset(fromCbor)
+            || queue.size() != 1 || queue.front().id != 0
+            || queue.front().score != 0 || queue.front().tags != std::vector{1}) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "reused", json::serialize(reused).c_str());
+        return;
+    }
+    if (sparse != "{\"id\":0,\"tags\":[]}"
+            || full != "{\"id\":0,\"name\":\"child\",\"tags\":[],\"parent\":"
+                "{\"id\":0,\"tags\":[],\"score\":0.500000},\"counts\":{\"a\":1}}"
+            || json::serialize(parsed) != full
+            || json::cbor::serialize(binary) != json::cbor::serialize(event)
+            || json::fieldCount(*event.parent) != 3) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "sparse", sparse.c_str());
+        printf("    %-15s %s\n", "full", full.c_str());
+        return;
+    }
+    printf("PASS\n");
+}
+
+void projectionTest() {
+    printf("%-20s", "projection");
+    using Selected = json::fields<&Event::score, &Event::id>;
+    std::string text =
+        "{\"name\":\"a \\\"}] \\\\\",\"tags\":[1, [2, {\"x\": \"]\"}], -3e4],"
+        " \"parent\": {\"id\": 9, /* } */ \"score\": 2}, \"id\": 7,"
+        " \"other\": null, \"score\": 1.5, \"counts\": this is never read";
+    json::result<Event> res = json::try_deserialize<Event, Selected>(text);
+    // without all the fields, the whole object is read
+    Event partial = json::deserialize<Event, json::fields<&Event::id>>(
+        "{\"name\": \"x\", \"score\": true, \"id\": 3}");
+    json::result<Event> missing = json::try_deserialize<Event, Selected>(
+        "{\"id\": 3, \"name\": {\"a\": [1, \"]}\"}");
+    json::result<Event> trailing = json::try_deserialize<Event, Selected>(
+        "{\"id\": 3} x");
+    // a skipped string cut off inside an escape, in a buffer of exactly its
+    // size so that reading past it is caught under asan
+    const char escaped[] = "{\"x\": 1, \"y\":\"\\";
+    std::unique_ptr<char[]> exact(new char[sizeof(escaped) - 1]);
+    memcpy(exact.get(), escaped, sizeof(escaped) - 1);
+    json::result<Event> cut = json::try_deserialize<Event, Selected>(
+        std::string_view(exact.get(), sizeof(escaped) - 1));
+    if (!res || res.value.id != 7 || res.value.score != 1.5
+            || res.value.name || !res.value.tags.empty() || res.value.parent
+            || partial.id != 3
+            || missing
+            || trailing.error.description != "expected EOF"
+            || cut) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "error", res.error.description.c_str());
+        printf("    %-15s %s\n", "missing", missing.error.description.c_str());
+        return;
+    }
+    printf("PASS\n");
+}
+
+void fieldMaskTest() {
+    printf("%-20s", "field masks");
+    MassiveStruct massive = exampleMassiveStruct();
+    auto mask = json::field_mask<MassiveStruct>::compile(
+        "int1,structs1.integer,structs2.string,structs3.integer,"
+        "optional5.integers,tuple2,optional1");
+    std::string masked = json::serialize(massive, mask);
+    // a later whole field wins over a nested path
+    auto whole = json::field_mask<MassiveStruct>::compile("structs3.integer,structs3");
+    std::string structs3 = json::serialize(massive, whole);
+    auto prices = json::field_mask<RealisticStruct>::compile("integer");
+    std::string list = json::serialize(massive.structs1, prices);
+    json::Options canonical;
+    canonical.canonical = true;
+    auto two = json::field_mask<RealisticStruct>::compile("string,float1");
+    std::string sorted = json::serialize(massive.structs1[0], two, canonical);
+    const std::pair<std::string, json::error> cases[] = {
+        {"int1.x", {"field 'int1' has no fields", 4}},
+        {"int1,nope", {"unknown field 'nope'", 5}},
+        {"structs1.", {"expected field name", 9}},
+        {"int1,", {"expected field name", 5}},
+    };
+    for (const auto &[paths, expected] : cases) {
+        auto res = json::field_mask<MassiveStruct>::try_compile(paths);
+        if (res.error.description != expected.description
+                || res.error.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "paths", paths.c_str());
+            printf("    %-15s %s %lld\n", "desc", res.error.description.c_str(), (long long)res.error.idx);
+            return;
+        }
+    }
+    if (masked != "{\"int1\":1,\"structs1\":[{\"integer\":100},{\"integer\":-200},"
+                "{\"integer\":300},{\"integer\":400}],\"structs2\":[{\"string\":"
+                "\"foo\"},{\"string\":\"bar\"},{\"string\":\"baz\"}],\"structs3\":"
+                "{\"bar\":{\"integer\":2},\"baz\":{\"integer\":3},\"foo\":"
+                "{\"integer\":1}},\"optional1\":null,\"optional5\":{\"integers\":"
+                "[1,2,3,4,5,6,7,8,9]},\"tuple2\":[]}"
+            || structs3 != "{\"structs3\":" + json::serialize(massive.structs3) + "}"
+            || list != "[{\"integer\":100},{\"integer\":-200},{\"integer\":300},"
+                "{\"integer\":400}]"
+            || sorted != "{\"float1\":1.345,\"string\":\"foo\"}"
+            || json::serialize(massive, json::field_mask<MassiveStruct>())
+                != json::serialize(massive)) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "masked", masked.c_str());
+        printf("    %-15s %s\n", "sorted", sorted.c_str());
+        return;
+    }
+    printf("PASS\n");
+}
+
 void linkedListTest() {
     Node<int> root;
     root.value = 10;
@@ -746,43 +1079,911 @@ void commentTest() {
     printf("PASS\n");
 }
 
-int main() {
-    if constexpr (false) {
-        RealisticStruct realisticStruct;
-        realisticStruct.string = "foo bar baz";
-        realisticStruct.integer = 1;
-        realisticStruct.float1 = 1.5;
-        realisticStruct.float2 = 3.0;
-        realisticStruct.integers = {10, 20, 30, 40, 50};
-
-        std::string json = json::serialize(realisticStruct);
-        printf("%s\n", json.c_str());
-        printf("%s\n", prettifier.prettify(json).c_str());
-        return 0;
-
-        int total = 0;
-        for (int i = 0; i < 5'000'000; i++) {
-            std::string json = json::serialize(realisticStruct);
-            RealisticStruct deserialized = json::deserialize<RealisticStruct>(json);
-            total += deserialized.integer;
+void utf8Test() {
+    printf("%-20s", "utf-8 validation");
+    std::string valid = "\"t\xc3\xb7\xe2\x94\x94\xf0\x9f\x92\xa3\"";
+    if (json::deserialize<std::string>(valid) != valid.substr(1, 10)) {
+        printf("FAIL\n");
+        return;
+    }
+    const std::pair<std::string, int> cases[] = {
+        {"\"abc\xff\"", 4},
+        {"\"abc\xc3\"", 4},
+        {"\"abcdefghijklmnopq\xc0\xaf\"", 18},
+        {"\"abcdefghijklmnop\xed\xa0\x80\"", 17},
+        {"\"\\n\xf4\x90\x80\x80\"", 3},
+        {"\"\xe2\x94\\n\"", 1},
+    };
+    for (const auto &[json, idx] : cases) {
+        json::result<std::string> res = json::try_deserialize<std::string>(json);
+        if (res || res.error.idx != idx) {
+            printf("FAIL\n");
+            printf("    %-15s %lld\n", "idx", (long long)res.error.idx);
+            return;
+        }
+    }
+    try {
+        json::serialize(std::string("ok\xe2\x94"));
+        printf("FAIL\n");
+        return;
+    }
+    catch (const json::exception &ex) {
+        if (ex.idx != 2) {
+            printf("FAIL\n");
+            return;
         }
-        printf("%d\n", total);
-    }
-    else {
-        stringTest();
-        charTest();
-        intTest();
-        floatTest();
-        vectorTest();
-        listTest();
-        setTest();
-        dequeTest();
-        queueTest();
-        arrayTest();
-        mapTest();
-        structTest();
-        linkedListTest();
-        treeTest();
-        commentTest();
     }
+    printf("PASS\n");
+}
+
+void encodingTest() {
+    printf("%-20s", "encoding options");
+    std::string text = "caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80\n";
+    std::string ascii = "\"caf\\u00e9 \\u65e5\\u672c \\ud83d\\ude00\\n\"";
+    if (json::serialize(text) != ascii) {
+        printf("FAIL\n");
+        return;
+    }
+    json::Options options;
+    options.encodeAscii = false;
+    if (json::serialize(text, options) != '"' + text.substr(0, 17) + "\\n\"") {
+        printf("FAIL\n");
+        return;
+    }
+    if (json::deserialize<std::string>(ascii) != text) {
+        printf("FAIL\n");
+        return;
+    }
+    options.validateUtf8 = false;
+    std::string invalid = "\"\xff\"";
+    if (json::deserialize<std::string>(invalid, options) != "\xff") {
+        printf("FAIL\n");
+        return;
+    }
+    if (json::try_deserialize<std::string>(invalid)) {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+void fieldOrderTest() {
+    printf("%-20s", "field order");
+    RealisticStruct expected {"foo", 42, 1.5, 2.5, {1, 2}};
+    const char *inputs[] = {
+        "{\"integers\":[1,2],\"float2\":2.5,\"float1\":1.5,\"integer\":42,"
+        "\"string\":\"foo\"}",
+        "{\"string\":\"foo\",\"float1\":1.5,\"integer\":42,\"float2\":2.5,"
+        "\"integers\":[1,2]}",
+        "{\"string\" : \"foo\",\"\\u0069nteger\":42,\"float1\":1.5,"
+        "\"float2\":2.5,\"integers\":[1,2]}",
+    };
+    for (const char *input : inputs) {
+        if (!equals(json::deserialize<RealisticStruct>(input), expected)) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", input);
+            return;
+        }
+    }
+    json::result<RealisticStruct> res = json::try_deserialize<RealisticStruct>(
+        "{\"string\":\"foo\",\"strings\":[]}");
+    if (res.error.description != "unknown key 'strings'" || res.error.idx != 16) {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+void numberArrayTest() {
+    printf("%-20s", "number arrays");
+    std::vector<double> doubles = json::deserialize<std::vector<double>>(
+        "[1.5,-2,3e2, 4.25E-1 ,/* five */ 5\n,\n6]");
+    if (doubles != std::vector<double>{1.5, -2, 300, 0.425, 5, 6}) {
+        printf("FAIL\n");
+        return;
+    }
+    std::vector<int> large;
+    for (int i = 0; i < 100000; i++) {
+        large.push_back(i * 7 - 350000);
+    }
+    if (json::deserialize<std::vector<int>>(json::serialize(large)) != large) {
+        printf("FAIL\n");
+        return;
+    }
+    short shorts[3];
+    json::deserialize(shorts, "[ 1 , 2 ]");
+    if (shorts[0] != 1 || shorts[1] != 2) {
+        printf("FAIL\n");
+        return;
+    }
+    const std::pair<std::string, json::error> cases[] = {
+        {"[1,2,3,4]", {"expected ']' but got ','", 7}},
+        {"[1,70000]", {"invalid number", 8}},
+        {"[1,-]", {"invalid number", 3}},
+    };
+    for (const auto &[json, expected] : cases) {
+        json::error err = json::try_deserialize(shorts, json);
+        if (err.description != expected.description || err.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", json.c_str());
+            printf("    %-15s %s %lld\n", "desc", err.description.c_str(), (long long)err.idx);
+            return;
+        }
+    }
+    std::vector<bool> bools = json::deserialize<std::vector<bool>>(
+        "[true, false,true]");
+    if (bools != std::vector<bool>{true, false, true}
+            || json::try_deserialize<std::vector<bool>>("[truex]")) {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+void prettyTest() {
+    printf("%-20s", "pretty options");
+    json::Options options;
+    options.indent = 2;
+    options.newline = "\r\n";
+    std::map<std::string, std::vector<int>> map {{"a", {1, 2}}, {"b", {}}};
+    std::string expected =
+        "{\r\n  \"a\": [\r\n    1,\r\n    2\r\n  ],\r\n  \"b\": []\r\n}";
+    if (json::serialize(map, options) != expected) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "serialized", json::serialize(map, options).c_str());
+        return;
+    }
+    if (json::deserialize<decltype(map)>(expected) != map) {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+void reformatTest() {
+    printf("%-20s", "reformat");
+    std::string input =
+        "{ // comment\r\n  \"a\\\"/*\" : [1, 2.5 ,\r\n true],/* block ** comment */\r\n"
+        "  \"b\":{ }, \"c\" : [ ] }";
+    std::string pretty =
+        "{\n  \"a\\\"/*\": [\n    1,\n    2.5,\n    true\n  ],\n"
+        "  \"b\": {},\n  \"c\": []\n}";
+    std::string minified = "{\"a\\\"/*\":[1,2.5,true],\"b\":{},\"c\":[]}";
+    if (json::prettify(input, 2) != pretty || json::minify(input) != minified) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "prettified", json::prettify(input, 2).c_str());
+        printf("    %-15s %s\n", "minified", json::minify(input).c_str());
+        return;
+    }
+    // every split point of the input must give the same output
+    for (size_t split = 0; split <= input.size(); split++) {
+        std::string output;
+        auto sink = [&](const char *data, size_t size) {
+            output.append(data, size);
+        };
+        json::Options options;
+        options.indent = 2;
+        json::Writer writer(sink, options);
+        json::Reformatter reformatter(writer);
+        reformatter.feed(std::string_view(input).substr(0, split));
+        reformatter.feed(std::string_view(input).substr(split));
+        reformatter.finish();
+        if (output != pretty) {
+            printf("FAIL\n");
+            printf("    %-15s %zu\n", "split", split);
+            return;
+        }
+    }
+    printf("PASS\n");
+}
+
+void msgpackTest() {
+    printf("%-20s", "msgpack");
+    const std::pair<std::string, std::string> cases[] = {
+        {json::msgpack::serialize(std::map<std::string, int>{{"a", 1}}),
+            std::string("\x81\xa1" "a\x01")},
+        {json::msgpack::serialize(-1), "\xff"},
+        {json::msgpack::serialize(200), "\xcc\xc8"},
+        {json::msgpack::serialize(-200), "\xd1\xff\x38"},
+        {json::msgpack::serialize(1.5f), std::string("\xca\x3f\xc0\0\0", 5)},
+        {json::msgpack::serialize(std::optional<int>()), "\xc0"},
+        {json::msgpack::serialize(std::vector<uint8_t>{1, 2}),
+            std::string("\xc4\x02\x01\x02")},
+        {json::msgpack::serialize(std::map<int, bool>{{-1, true}}),
+            "\x81\xff\xc3"},
+    };
+    for (const auto &[serialized, expected] : cases) {
+        if (serialized != expected) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "expected", expected.c_str());
+            return;
+        }
+    }
+    RealisticStruct realisticStruct {"foo", 42, 1.5, 2.5, {1, 2, 3}};
+    std::string bytes = json::msgpack::serialize(realisticStruct);
+    std::vector<uint8_t> buffer(bytes.begin(), bytes.end());
+    RealisticStruct unpacked =
+        json::msgpack::deserialize<RealisticStruct>(buffer);
+    if (json::serialize(unpacked) != json::serialize(realisticStruct)) {
+        printf("FAIL\n");
+        return;
+    }
+    json::result<RealisticStruct> truncated =
+        json::msgpack::try_deserialize<RealisticStruct>(
+            std::string_view(bytes).substr(0, bytes.size() - 1));
+    json::result<int8_t> overflow =
+        json::msgpack::try_deserialize<int8_t>(json::msgpack::serialize(200));
+    json::result<std::string> notString =
+        json::msgpack::try_deserialize<std::string>("\x01");
+    if (truncated.error.description != "unexpected end of input"
+            || overflow.error.description != "integer out of range"
+            || notString.error.description != "expected string") {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+struct Blob {
+    std::string name;
+    std::vector<uint8_t> data;
+    std::span<const uint8_t> view;
+};
+REFLECT(Blob, name, data, view);
+
+void cborTest() {
+    printf("%-20s", "cbor");
+    // examples from RFC 8949 appendix A
+    const std::pair<std::string, std::string> cases[] = {
+        {json::cbor::serialize(0), std::string("\x00", 1)},
+        {json::cbor::serialize(24), "\x18\x18"},
+        {json::cbor::serialize(1000), "\x19\x03\xe8"},
+        {json::cbor::serialize(-1000), "\x39\x03\xe7"},
+        {json::cbor::serialize(1000000000000),
+            std::string("\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00", 9)},
+        {json::cbor::serialize(std::string("a")), "\x61\x61"},
+        {json::cbor::serialize(std::vector<int>{1, 2, 3}), "\x83\x01\x02\x03"},
+        {json::cbor::serialize(std::map<std::string, int>{{"a", 1}}),
+            "\xa1\x61\x61\x01"},
+        {json::cbor::serialize(std::vector<uint8_t>{1, 2, 3, 4}),
+            "\x44\x01\x02\x03\x04"},
+        {json::cbor::serialize(true), "\xf5"},
+        {json::cbor::serialize(std::optional<int>()), "\xf6"},
+    };
+    for (const auto &[serialized, expected] : cases) {
+        if (serialized != expected) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "expected", expected.c_str());
+            return;
+        }
+    }
+    // half floats, tags and indefinite lengths are only ever decoded
+    std::string_view half("\xf9\x3e\x00", 3);
+    if (json::cbor::deserialize<double>(half) != 1.5
+            || json::cbor::deserialize<int64_t>("\xc1\x1a\x51\x4b\x67\xb0")
+                != 1363896240
+            || json::cbor::deserialize<std::vector<int>>("\x9f\x01\x02\xff")
+                != std::vector<int>{1, 2}
+            || json::cbor::deserialize<std::map<int, int>>("\xbf\x01\x02\xff")
+                != std::map<int, int>{{1, 2}}) {
+        printf("FAIL\n");
+        return;
+    }
+    std::vector<uint8_t> bytes {0, 1, 2, 255};
+    Blob blob {"blob", bytes, bytes};
+    std::string encoded = json::cbor::serialize(blob);
+    Blob decoded = json::cbor::deserialize<Blob>(encoded);
+    const uint8_t *begin = (const uint8_t *)encoded.data();
+    if (decoded.name != "blob" || decoded.data != bytes
+            || decoded.view.size() != bytes.size()
+            || decoded.view.data() < begin
+            || decoded.view.data() >= begin + encoded.size()
+            || !std::equal(bytes.begin(), bytes.end(), decoded.view.begin())) {
+        printf("FAIL\n");
+        return;
+    }
+    json::result<std::pair<int, int>> wrongSize =
+        json::cbor::try_deserialize<std::pair<int, int>>("\x83\x01\x02\x03");
+    json::result<uint8_t> overflow = json::cbor::try_deserialize<uint8_t>(
+        std::string_view("\x19\x01\x00", 3));
+    if (wrongSize.error.description != "expected array of 2 elements"
+            || overflow.error.description != "integer out of range") {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+struct Catalog {
+    std::string name;
+    std::vector<RealisticStruct> items;
+    std::map<std::string, int> index;
+    std::optional<RealisticStruct> featured;
+    std::pair<int, std::string> pair;
+    int ids[3];
+    Keyword keyword;
+    Node<int> *list;
+};
+REFLECT(
+    Catalog, name, items, index, featured, pair, ids, keyword, list
+);
+
+void snapshotTest() {
+    printf("%-20s", "snapshot");
+    Catalog catalog {
+        "catalog",
+        {{"foo", 1, 1.5, 2.5, {1, 2, 3}}, {"bar", 2, 3.5, 4.5, {}}},
+        {{"a", 1}, {"b", 2}, {"c", 3}},
+        std::optional<RealisticStruct>(),
+        {5, "five"},
+        {7, 8, 9},
+        {"keyword"},
+        new Node<int>{1, new Node<int>{2, nullptr}},
+    };
+    std::string data = json::snapshot::serialize(catalog);
+    if (json::snapshot::verify<Catalog>(data)) {
+        printf("FAIL\n");
+        return;
+    }
+    auto view = json::snapshot::view<Catalog>(data);
+    auto items = view.get<&Catalog::items>();
+    auto list = view.get<&Catalog::list>();
+    if (view.get<&Catalog::name>() != "catalog"
+            || items.size() != 2
+            || items[0].get<&RealisticStruct::integers>()[2] != 3
+            || items[1].get<&RealisticStruct::string>() != "bar"
+            || items[1].get<&RealisticStruct::float2>() != 4.5
+            || view.get<&Catalog::index>().find("b")->get() != 2
+            || view.get<&Catalog::index>().find("d")
+            || view.get<&Catalog::featured>()
+            || view.get<&Catalog::pair>().get<1>() != "five"
+            || view.get<&Catalog::ids>()[2] != 9
+            || view.get<&Catalog::keyword>().get().value != "keyword"
+            || (*(*list).get<&Node<int>::next>()).get<&Node<int>::value>() != 2) {
+        printf("FAIL\n");
+        return;
+    }
+    // a string length running past the end of the file
+    std::string corrupt = data;
+    size_t nameLength = sizeof(json::snapshot::Header) + 8;
+    corrupt[nameLength + 7] = 1;
+    if (json::snapshot::verify<Catalog>(corrupt).description
+            != "offset out of bounds") {
+        printf("FAIL\n");
+        return;
+    }
+    json::snapshot::save(catalog, "snapshot_test.bin");
+    json::snapshot::Mapping<Catalog> mapping;
+    json::error err = mapping.open("snapshot_test.bin");
+    std::remove("snapshot_test.bin");
+    if (err || mapping.root().get<&Catalog::ids>()[0] != 7) {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+void fileTest() {
+    printf("%-20s", "files");
+    MassiveStruct massive = exampleMassiveStruct();
+    json::Options options;
+    options.indent = 2;
+    json::error saved = json::save_file("file_test.json", massive, options);
+    json::result<MassiveStruct> loaded =
+        json::try_load_file<MassiveStruct>("file_test.json");
+    json::save_file("file_test.json", std::vector<int>{1, 2, 3}, options);
+    json::result<MassiveStruct> wrong =
+        json::try_load_file<MassiveStruct>("file_test.json");
+    // a failed save leaves the previous file and no temporary behind
+    json::error invalid = json::save_file(
+        "file_test.json", std::vector<std::string>{"ok", "\xff"}, options);
+    json::result<std::vector<int>> kept =
+        json::try_load_file<std::vector<int>>("file_test.json");
+    bool temporary = std::remove("file_test.json.tmp") == 0;
+    std::remove("file_test.json");
+    json::result<MassiveStruct> missing =
+        json::try_load_file<MassiveStruct>("file_test.json");
+    if (saved || !loaded
+            || json::serialize(loaded.value) != json::serialize(massive)
+            || wrong.error.description != "expected '{' but got '['"
+            || invalid.description != "invalid utf-8 codepoint"
+            || !kept || kept.value.size() != 3 || temporary
+            || !missing.error.description.starts_with("cannot open 'file_test.json'")
+            || !json::save_file("no/such/dir.json", massive)) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "loaded", loaded.error.description.c_str());
+        printf("    %-15s %s\n", "wrong", wrong.error.description.c_str());
+        return;
+    }
+    printf("PASS\n");
+}
+
+void arrayReaderTest() {
+    printf("%-20s", "array reader");
+    // more than one buffer, with an element larger than the buffer
+    std::vector<RealisticStruct> rows(3000, exampleRealisticStruct());
+    for (size_t i = 0; i < rows.size(); i++) {
+        rows[i].integer = i;
+    }
+    rows[1500].string = std::string(200000, 'x') + "\\\"]";
+    json::Options options;
+    options.indent = 1;
+    json::save_file("array_test.json", rows, options);
+    json::array_reader<RealisticStruct> reader;
+    json::error opened = reader.open("array_test.json");
+    size_t count = 0;
+    bool same = true;
+    for (RealisticStruct &row : reader) {
+        same = same && count < rows.size()
+            && json::serialize(row) == json::serialize(rows[count]);
+        count++;
+    }
+    auto read = [](std::string_view text) {
+        FILE *file = fopen("array_test.json", "wb");
+        fwrite(text.data(), 1, text.size(), file);
+        fclose(file);
+        json::array_reader<int> reader;
+        reader.open("array_test.json");
+        std::vector<int> items;
+        for (int item : reader) {
+            items.push_back(item);
+        }
+        return std::make_pair(items, reader.error());
+    };
+    auto empty = read(" [ /* none */ ] // done");
+    auto ints = read("[1,\n2 ,3]");
+    auto bad = read("[1, 2, x]");
+    auto trailing = read("[1] 2");
+    auto cut = read("[1, \"\\");
+    std::remove("array_test.json");
+    if (opened || reader.error() || count != rows.size() || !same
+            || !empty.first.empty() || empty.second
+            || ints.first != std::vector<int>{1, 2, 3} || ints.second
+            || bad.first != std::vector<int>{1, 2}
+            || bad.second.description != "invalid number" || bad.second.idx != 7
+            || trailing.second.description != "expected EOF"
+            || cut.first != std::vector<int>{1} || !cut.second) {
+        printf("FAIL\n");
+        printf("    %-15s %zu\n", "count", count);
+        printf("    %-15s %s\n", "error", reader.error().description.c_str());
+        printf("    %-15s %s\n", "bad", bad.second.description.c_str());
+        return;
+    }
+    printf("PASS\n");
+}
+
+// the allocations of one serialize and one deserialize of `item`, which
+// must stay within the given budgets. deserializing counts the allocations
+// of the value being built.
+template <typename T>
+void allocationTest(
+    std::string desc, const T &item,
+    size_t serializeBudget, size_t deserializeBudget
+) {
+    printf("%-20s", desc.c_str());
+    std::string json;
+    size_t serialized = countAllocations([&] {
+        json = json::serialize(item);
+    });
+    T deserialized{};
+    size_t deserializedCount = countAllocations([&] {
+        json::deserialize(deserialized, json);
+    });
+    if (serialized > serializeBudget || deserializedCount > deserializeBudget) {
+        printf("FAIL\n");
+        printf("    %-15s %zu (budget %zu)\n", "serialize",
+            serialized, serializeBudget);
+        printf("    %-15s %zu (budget %zu)\n", "deserialize",
+            deserializedCount, deserializeBudget);
+        return;
+    }
+    printf("PASS\n");
+}
+
+void allocationsTest() {
+    std::map<std::string, int> map;
+    for (int i = 0; i < 100; i++) {
+        map["key " + std::to_string(i)] = i;
+    }
+    // serializing grows one output buffer. deserializing should allocate
+    // only the strings, elements and nodes of the value itself.
+    allocationTest("allocs string", std::string(1000, 'x'), 2, 1);
+    allocationTest("allocs realistic", exampleRealisticStruct(), 1, 1);
+    allocationTest("allocs massive", exampleMassiveStruct(), 4, 21);
+    allocationTest("allocs map", map, 4, 100);
+}
+
+void canonicalTest() {
+    printf("%-20s", "canonical");
+    std::unordered_map<int, std::string> unordered;
+    std::map<int, std::string> ordered;
+    for (int i = 0; i < 40; i++) {
+        unordered[i * 7] = std::to_string(i);
+        ordered[i * 7] = std::to_string(i);
+    }
+    json::Options options;
+    options.canonical = true;
+    std::string canonical = json::serialize(unordered, options);
+    json::XXHash64 expected;
+    expected.update(canonical.data(), canonical.size());
+    // keys sort by their text, fields by name, and numbers take one form
+    json::document doc = json::deserialize<json::document>(
+        "{\"string\":\"foo\",\"integer\":1,\"float1\":-0.0,"
+        "\"integers\":[],\"float2\":2.50}");
+    RealisticStruct realistic{"foo", 1, 0.0f, 2.5f, {}};
+    // the reference xxh64 digests with seed 0, the last fed in two pieces
+    auto xxh64 = [](std::string_view text, size_t split) {
+        json::XXHash64 hasher;
+        hasher.update(text.data(), split);
+        hasher.update(text.data() + split, text.size() - split);
+        return hasher.digest();
+    };
+    std::string_view spam = "Nobody inspects the spammish repetition";
+    if (xxh64("", 0) != 0xef46db3751d8e999 || xxh64("a", 1) != 0xd24ec4f1a98c6e5b
+            || xxh64("abc", 1) != 0x44bc2cf5ad770999
+            || xxh64(spam, 0) != 0xfbcea83c8a378bf1
+            || xxh64(spam, 35) != 0xfbcea83c8a378bf1) {
+        printf("FAIL\n");
+        printf("    %-15s %016llx\n", "xxh64(abc)", (unsigned long long)xxh64("abc", 0));
+        return;
+    }
+    if (canonical != json::serialize(ordered, options)
+            || !canonical.starts_with("{\"0\":\"0\",\"105\":")
+            || json::hash(unordered) != json::hash(ordered)
+            || json::hash(unordered) != expected.digest()
+            || json::hash(ordered) == json::hash(std::map<int, int>{{0, 0}})
+            || json::serialize(doc, options) != json::serialize(realistic, options)
+            || json::serialize(realistic, options)
+                != "{\"float1\":0,\"float2\":2.5,\"integer\":1,"
+                    "\"integers\":[],\"string\":\"foo\"}") {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "canonical", canonical.substr(0, 40).c_str());
+        printf("    %-15s %s\n", "document", json::serialize(doc, options).c_str());
+        return;
+    }
+    std::vector<RealisticStruct> structs(1000, exampleRealisticStruct());
+    std::unordered_set<std::string> small = {"b", "a", "c"};
+    size_t allocated = countAllocations([&] {
+        json::hash(structs);
+        json::hash(small);
+    });
+    if (allocated != 0) {
+        printf("FAIL\n");
+        printf("    %-15s %zu\n", "allocations", allocated);
+        return;
+    }
+    printf("PASS\n");
+}
+
+void documentTest() {
+    printf("%-20s", "document");
+    std::string json = R"({"name":"foo","ids":[1,-2,3.5,18446744073709551615],)"
+        R"("nested":{"ok":true,"none":null,"text":"a\"b"},"empty":[]})";
+    json::document doc = json::deserialize<json::document>(json);
+    json::value root = doc.root();
+    int64_t sum = 0;
+    for (json::value id : root["ids"]) {
+        if (id.type() == json::Type::INTEGER) {
+            sum += id.get<int64_t>();
+        }
+    }
+    if (json::serialize(doc) != json
+            || root.size() != 4
+            || root["ids"].size() != 4
+            || sum != -1
+            || root["ids"][2].get<double>() != 3.5
+            || root["ids"][3].get<uint64_t>() != UINT64_MAX
+            || root["name"].string() != "foo"
+            || root["nested"]["text"].string() != "a\"b"
+            || !root["nested"]["ok"].get<bool>()
+            || !root["nested"]["none"].isNull()
+            || root.find("missing")
+            || !root["empty"].empty()) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "json", json::serialize(doc).c_str());
+        return;
+    }
+    // parsing again reuses the nodes and strings of the last parse
+    size_t reparse = countAllocations([&] {
+        json::deserialize(doc, json);
+    });
+    json::result<json::document> bad =
+        json::try_deserialize<json::document>("{\"a\":[1,}");
+    // nesting is bounded like validate(), instead of by the call stack
+    std::string deep = std::string(1000000, '[') + std::string(1000000, ']');
+    json::result<json::document> tooDeep =
+        json::try_deserialize<json::document>(deep);
+    std::string limit = std::string(4096, '[') + std::string(4096, ']');
+    if (reparse != 0 || bad.error.description != "expected value"
+            || bad.error.idx != 8 || !bad.value.empty()
+            || tooDeep.error.description != "nesting too deep"
+            || tooDeep.error.idx != 4096
+            || !json::try_deserialize<json::document>(limit)) {
+        printf("FAIL\n");
+        printf("    %-15s %zu\n", "allocations", reparse);
+        printf("    %-15s %s\n", "error", bad.error.description.c_str());
+        return;
+    }
+    printf("PASS\n");
+}
+
+enum class Level : uint8_t { LOW, HIGH };
+
+void validateTest() {
+    printf("%-20s", "validate");
+    std::string massive = json::serialize(exampleMassiveStruct());
+    std::vector<RealisticStruct> structs(10, exampleRealisticStruct());
+    std::string realistic = json::serialize(structs);
+    json::error err;
+    size_t allocated = countAllocations([&] {
+        err = json::validate(realistic);
+        if (!err) {
+            err = json::validate<std::vector<RealisticStruct>>(realistic);
+        }
+    });
+    // the custom Keyword fields are bare words, only valid for the type
+    if (err || allocated != 0 || json::validate<MassiveStruct>(massive)
+            || json::validate(massive).description.find("invalid keyword") != 0) {
+        printf("FAIL\n");
+        printf("    %-15s %zu\n", "allocations", allocated);
+        printf("    %-15s %s\n", "error", err.description.c_str());
+        return;
+    }
+    const std::pair<std::string, json::error> cases[] = {
+        {"[1,]", {"expected value", 3}},
+        {"{\"a\" 1}", {"expected ':' but got '1'", 6}},
+        {"[01]", {"expected ',' but got '1'", 3}},
+        {"-.5", {"invalid number", 1}},
+        {"\"\\x\"", {"invalid escape character", 2}},
+        {"\"\\ud800\"", {"expected utf-8 surrogate pair", 6}},
+        {"\"\xc3\"", {"invalid utf-8 codepoint", 1}},
+        {"\"a\tb\"", {"unescaped control character", 2}},
+        {"nul", {"invalid keyword 'nul'", 0}},
+        {"[] []", {"expected EOF", 3}},
+        {"[1 /*c*/]", {"expected ',' but got '/'", 4}},
+        {"// hi\n1", {"expected value", 0}},
+        {"[1,\v2]", {"expected value", 3}},
+        {"1\f", {"expected EOF", 1}},
+        {std::string(5000, '['), {"nesting too deep", 4096}},
+    };
+    for (const auto &[json, expected] : cases) {
+        err = json::validate(json);
+        if (err.description != expected.description || err.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", json.substr(0, 20).c_str());
+            printf("    %-15s %s at %lld\n", "error",
+                err.description.c_str(), (long long)err.idx);
+            return;
+        }
+    }
+    // the shape of the type, reported where deserializing would fail
+    const std::string typed[] = {
+        "{\"integer\":3000000000}",
+        "{\"integer\":\"1\"}",
+        "{\"integers\":{}}",
+        "{\"unknown\":1}",
+        "{\"float1\":true}",
+    };
+    for (const std::string &json : typed) {
+        err = json::validate<RealisticStruct>(json);
+        json::error expected = json::try_deserialize<RealisticStruct>(json).error;
+        if (!err || err.description != expected.description
+                || err.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", json.c_str());
+            printf("    %-15s %s at %lld\n", "error",
+                err.description.c_str(), (long long)err.idx);
+            return;
+        }
+    }
+    if (json::validate<int[2]>("[1,2,3]").description != "expected ']' but got ','"
+            || json::validate<std::map<int, bool>>("{\"x\":true}").description
+                != "invalid key"
+            || !json::validate<std::vector<int>>("[1, /* 2 */ 3]")
+            || json::validate<RealisticStruct>(
+                "{\"\\u0073tring\": \"x\", \"\\u0069nteger\": 1}")
+            || json::validate<std::vector<double>>("[01]").description
+                != "expected ',' but got '1'"
+            || json::validate<std::vector<double>>("[1.]").description
+                != "invalid number"
+            || json::validate<std::vector<double>>("[-0.5, 1e5]")
+            || !json::validate<Level>("300") || json::validate<Level>("3")) {
+        printf("FAIL\n");
+        return;
+    }
+    printf("PASS\n");
+}
+
+// records every event as text
+struct SaxRecorder {
+    std::string events;
+
+    void start_object() { events += "{"; }
+    void end_object() { events += "}"; }
+    void start_array() { events += "["; }
+    void end_array() { events += "]"; }
+    void key(std::string_view key) { events += "k:" + std::string(key) + " "; }
+    void string(std::string_view string) { events += "s:" + std::string(string) + " "; }
+    void number(std::string_view raw) { events += "n:" + std::string(raw) + " "; }
+    void boolean(bool value) { events += value ? "true " : "false "; }
+    void null() { events += "null "; }
+};
+
+// sums the numbers up to a limit, ignoring every other event
+struct SaxSummer {
+    double sum = 0;
+    int count = 0;
+
+    bool number(std::string_view raw) {
+        double value = 0;
+        std::from_chars(raw.data(), raw.data() + raw.size(), value);
+        sum += value;
+        return ++count < 3;
+    }
+};
+
+void saxTest() {
+    printf("%-20s", "sax");
+    SaxRecorder recorder;
+    json::error err = json::sax::parse(
+        "{\"a\": [1, -2.5e3, \"x\\ny\", {}], /* c */ \"b\\u00e9\": {\"c\": true,"
+        " \"d\": [false, null, []]}}", recorder);
+    SaxSummer summer;
+    json::error stopped = json::sax::parse("[1, [2, 3], 4]", summer);
+    SaxSummer counter;
+    json::error counted = json::sax::parse("{\"a\": \"1\", \"b\": 2}", counter);
+    SaxRecorder trailing;
+    json::error eof = json::sax::parse("[1] 2", trailing);
+    SaxRecorder invalid;
+    json::error bad = json::sax::parse("[1, 01]", invalid);
+    if (err || recorder.events != "{k:a [n:1 n:-2.5e3 s:x\ny {}]k:b\xc3\xa9 {k:c true "
+                "k:d [false null []]}}"
+            || stopped.description != "stopped by the handler" || summer.sum != 6
+            || counted || counter.sum != 2
+            || eof.description != "expected EOF" || trailing.events != "[n:1 ]"
+            || bad.description != "expected ',' but got '1'" || bad.idx != 6) {
+        printf("FAIL\n");
+        printf("    %-15s %s\n", "events", recorder.events.c_str());
+        printf("    %-15s %s %lld\n", "bad", bad.description.c_str(), (long long)bad.idx);
+        return;
+    }
+    printf("PASS\n");
+}
+
+void instrumentTest() {
+    printf("%-20s", "instrument");
+    json::instrument::reset();
+    json::instrument::allocationCount = [] { return (uint64_t)allocations; };
+    static std::vector<json::instrument::Call> calls;
+    calls.clear();
+    json::instrument::onCall = [](const json::instrument::Call &call) {
+        calls.push_back(call);
+    };
+    MassiveStruct massive = exampleMassiveStruct();
+    std::string json = json::serialize(massive);
+    json::deserialize(massive, json);
+    json::instrument::onCall = nullptr;
+    json::instrument::allocationCount = nullptr;
+
+    const json::instrument::TypeStats *realistic = nullptr;
+    const json::instrument::TypeStats *top = nullptr;
+    json::instrument::forEachType([&](const json::instrument::TypeStats &stats) {
+        if (stats.type == "RealisticStruct") {
+            realistic = &stats;
+        }
+        else if (stats.type == "MassiveStruct") {
+            top = &stats;
+        }
+    });
+    if (calls.size() != 2
+            || calls[0].type != "MassiveStruct"
+            || calls[0].operation != json::instrument::SERIALIZE
+            || calls[0].stats.bytes != json.size()
+            || calls[0].stats.allocations != 4
+            || calls[1].operation != json::instrument::DESERIALIZE
+            || calls[1].stats.bytes != json.size()
+            || calls[0].stats.maxDepth != calls[1].stats.maxDepth
+            || calls[0].stats.numbers != calls[1].stats.numbers
+            || calls[0].stats.strings != calls[1].stats.strings
+            || !top || top->serialize.calls != 1 || top->deserialize.calls != 1
+            || strlen(top->type.data()) != top->type.size()
+            || !realistic
+            || realistic->serialize.calls != realistic->deserialize.calls
+            || realistic->serialize.numbers != realistic->deserialize.numbers
+            || realistic->serialize.maxDepth != 2) {
+        printf("FAIL\n");
+        for (const auto &call : calls) {
+            printf("    %-15s %s\n", "type", std::string(call.type).c_str());
+            printf("    %-15s %llu bytes, %d deep, %llu strings, %llu numbers,"
+                " %llu allocations\n", "stats",
+                (unsigned long long)call.stats.bytes, call.stats.maxDepth,
+                (unsigned long long)call.stats.strings,
+                (unsigned long long)call.stats.numbers,
+                (unsigned long long)call.stats.allocations);
+        }
+        return;
+    }
+    printf("PASS\n");
+}
+
+void errorTest() {
+    printf("%-20s", "try_deserialize");
+    json::result<RealisticStruct> ok =
+        json::try_deserialize<RealisticStruct>("{\"integer\":42}");
+    if (!ok || ok.value.integer != 42) {
+        printf("FAIL\n");
+        return;
+    }
+    const std::pair<std::string, json::error> cases[] = {
+        {"{\"integer\":42", {std::string("expected ',' but got '\0'", 24), 14}},
+        {"{\"string\":\"foo", {"unterminated string", 14}},
+        {"{\"string\":\"\\q\"}", {"invalid escape character", 12}},
+        {"{\"integers\":[1,x]}", {"invalid number", 15}},
+        {"{} x", {"expected EOF", 3}},
+    };
+    for (const auto &[json, expected] : cases) {
+        json::result<RealisticStruct> res =
+            json::try_deserialize<RealisticStruct>(json);
+        if (res.error.description != expected.description
+                || res.error.idx != expected.idx) {
+            printf("FAIL\n");
+            printf("    %-15s %s\n", "json", json.c_str());
+            printf("    %-15s %s\n", "desc", res.error.description.c_str());
+            return;
+        }
+        try {
+            json::deserialize<RealisticStruct>(json);
+            printf("FAIL\n");
+            return;
+        }
+        catch (const json::exception &ex) {
+            if (ex.idx != expected.idx) {
+                printf("FAIL\n");
+                return;
+            }
+        }
+    }
+    printf("PASS\n");
+}
+
+int main() {
+    stringTest();
+    charTest();
+    intTest();
+    floatTest();
+    vectorTest();
+    listTest();
+    setTest();
+    dequeTest();
+    queueTest();
+    arrayTest();
+    mapTest();
+    mapKeysTest();
+    flatTest();
+    canonicalTest();
+    structTest();
+    omitTest();
+    projectionTest();
+    fieldMaskTest();
+    linkedListTest();
+    treeTest();
+    commentTest();
+    errorTest();
+    utf8Test();
+    encodingTest();
+    fieldOrderTest();
+    numberArrayTest();
+    bytesTest();
+    prettyTest();
+    reformatTest();
+    msgpackTest();
+    cborTest();
+    snapshotTest();
+    fileTest();
+    arrayReaderTest();
+    allocationsTest();
+    documentTest();
+    validateTest();
+    saxTest();
+    instrumentTest();
 }